@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// std::vector allocator that aligns the buffer for SIMD loads
+template <typename T, size_t Alignment = 32>
+struct AlignedAllocator {
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() noexcept {}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T* p, size_t) noexcept {
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
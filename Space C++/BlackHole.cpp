@@ -1,8 +1,13 @@
 #include "BlackHole.h"
 #include "SolarSystem.h"
 #include "UI.h"
-#include <GLFW/glfw3.h>
+#include "Renderer.h"
+#include "Camera.h"
+#include "Lensing.h"
+#include "Bloom.h"
 #include <iostream>
+#include <cstddef>
+#include <algorithm>
 #include <cmath>
 #include <random>
 
@@ -32,7 +37,7 @@ void generateBlackHoles(std::vector<BlackHole>& blackHoles, const BlackHoleConfi
 		smbh.eventHorizonRadius = rsKm * KM_TO_SIM_UNITS * VISUAL_SCALE_FACTOR;
 		smbh.accretionDiskInnerRadius = smbh.eventHorizonRadius * 3.0f;
 		smbh.accretionDiskOuterRadius = smbh.eventHorizonRadius * 20.0f;
-		smbh.diskRotationAngle = 0.0f;
+		smbh.diskRotationPhase = 0;
 		smbh.diskRotationSpeed = 0.5f;
 
 		blackHoles.push_back(smbh);
@@ -41,312 +46,722 @@ void generateBlackHoles(std::vector<BlackHole>& blackHoles, const BlackHoleConfi
 
 void updateBlackHoles(std::vector<BlackHole>& blackHoles, double deltaTime) {
 	for (auto& bh : blackHoles) {
-		bh.diskRotationAngle += bh.diskRotationSpeed * deltaTime;
-		while (bh.diskRotationAngle > 2.0f * M_PI) {
-			bh.diskRotationAngle -= 2.0f * M_PI;
-		}
+		bh.diskRotationPhase += phaseStep(bh.diskRotationSpeed, deltaTime);
 	}
 }
 
-void renderBlackHoles(const std::vector<BlackHole>& blackHoles, const RenderZone& zone) {
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+// the disk's colour from the inner edge (t = 0) to the outer one (t = 1)
+static Color3 diskColor(float t) {
+	Color3 color;
+	if (t < 0.12f) {
+		color.r = 0.4f + t * 2.0f;
+		color.g = 0.5f + t * 2.5f;
+		color.b = 1.0f;
+	}
+	else if (t < 0.25f) {
+		float s = (t - 0.12f) / 0.13f;
+		color.r = 0.65f + s * 0.35f;
+		color.g = 0.8f + s * 0.2f;
+		color.b = 1.0f;
+	}
+	else if (t < 0.4f) {
+		color.r = 1.0f;
+		color.g = 1.0f;
+		color.b = 1.0f;
+	}
+	else if (t < 0.6f) {
+		float s = (t - 0.4f) / 0.2f;
+		color.r = 1.0f;
+		color.g = 1.0f - s * 0.2f;
+		color.b = 1.0f - s * 0.6f;
+	}
+	else if (t < 0.8f) {
+		float s = (t - 0.6f) / 0.2f;
+		color.r = 1.0f;
+		color.g = 0.8f - s * 0.4f;
+		color.b = 0.4f - s * 0.3f;
+	}
+	else {
+		float s = (t - 0.8f) / 0.2f;
+		color.r = 1.0f - s * 0.2f;
+		color.g = 0.4f - s * 0.25f;
+		color.b = 0.1f;
+	}
+	return color;
+}
 
-	for (const auto& bh : blackHoles) {
-		float visualScale = 1.5f;
+// how finely each part is tessellated, picked by zoom level
+struct BlackHoleQuality {
+	int diskRings, diskSegments, diskLayers;
+	int jetLayers, jetSegments;
+	int lensRings, lensSegments;
+	int latSegments, lonSegments;
+	int glowLayers;
+};
 
-		bool highQuality = false;
-		bool mediumQuality = false;
-		bool lowQuality = true;
+const int NUM_BLACK_HOLE_QUALITIES = 3;
+static const BlackHoleQuality BLACK_HOLE_QUALITIES[NUM_BLACK_HOLE_QUALITIES] = {
+	{ 10, 32, 1, 2, 12, 2, 24, 12, 16, 3 },		// low
+	{ 20, 64, 2, 3, 16, 4, 32, 16, 24, 6 },		// medium
+	{ 40, 128, 4, 4, 24, 8, 64, 24, 32, 12 },	// high
+};
 
-		if (zone.zoomLevel > 2000.0) {
-			highQuality = true;
-			mediumQuality = false;
-			lowQuality = false;
-		}
-		else if (zone.zoomLevel > 100.0) {
-			highQuality = false;
-			mediumQuality = true;
-			lowQuality = false;
-		}
+// one level down while the camera moves, one up once a paused view has held still (g_renderRefinement)
+static int blackHoleQualityLevel(const RenderZone& zone) {
+	int level = 0;
+	if (zone.zoomLevel > 2000.0) level = 2;
+	else if (zone.zoomLevel > 100.0) level = 1;
 
-		glPushMatrix();
-		glTranslatef(bh.x, bh.y, bh.z);
-
-		// accretion disk
-		int numRings, numSegments, numLayers;
-		if (highQuality) {
-			numRings = 40;
-			numSegments = 128;
-			numLayers = 4;
-		}
-		else if (mediumQuality) {
-			numRings = 20;
-			numSegments = 64;
-			numLayers = 2;
-		}
-		else {
-			numRings = 10;
-			numSegments = 32;
-			numLayers = 1;
-		}
+	level += std::min(g_renderRefinement, 2) - 1;
+	return std::max(0, std::min(level, NUM_BLACK_HOLE_QUALITIES - 1));
+}
 
-		for (int layer = 0; layer < numLayers; layer++) {
-			float layerAlpha = (layer == 0) ? 0.9f : (layer == 1) ? 0.5f : (layer == 2) ? 0.25f : 0.12f;
-			float layerScale = 1.0f + (float)layer * 0.2f;
-
-			for (int side = 0; side < 2; side++) {
-				float sideAlpha = (side == 0) ? 1.0f : 0.6f;
-
-				for (int ring = 0; ring < numRings - 1; ring++) {
-					float t1 = ring / (float)numRings;
-					float t2 = (ring + 1) / (float)numRings;
-
-					float innerRadius1 = (bh.accretionDiskInnerRadius +
-						t1 * (bh.accretionDiskOuterRadius - bh.accretionDiskInnerRadius))
-						* visualScale * layerScale;
-					float innerRadius2 = (bh.accretionDiskInnerRadius +
-						t2 * (bh.accretionDiskOuterRadius - bh.accretionDiskInnerRadius))
-						* visualScale * layerScale;
-
-					auto getColor = [](float t) -> Color3 {
-						Color3 color;
-						if (t < 0.12f) {
-							color.r = 0.4f + t * 2.0f;
-							color.g = 0.5f + t * 2.5f;
-							color.b = 1.0f;
-						}
-						else if (t < 0.25f) {
-							float s = (t - 0.12f) / 0.13f;
-							color.r = 0.65f + s * 0.35f;
-							color.g = 0.8f + s * 0.2f;
-							color.b = 1.0f;
-						}
-						else if (t < 0.4f) {
-							float s = (t - 0.25f) / 0.15f;
-							color.r = 1.0f;
-							color.g = 1.0f;
-							color.b = 1.0f;
-						}
-						else if (t < 0.6f) {
-							float s = (t - 0.4f) / 0.2f;
-							color.r = 1.0f;
-							color.g = 1.0f - s * 0.2f;
-							color.b = 1.0f - s * 0.6f;
-						}
-						else if (t < 0.8f) {
-							float s = (t - 0.6f) / 0.2f;
-							color.r = 1.0f;
-							color.g = 0.8f - s * 0.4f;
-							color.b = 0.4f - s * 0.3f;
-						}
-						else {
-							float s = (t - 0.8f) / 0.2f;
-							color.r = 1.0f - s * 0.2f;
-							color.g = 0.4f - s * 0.25f;
-							color.b = 0.1f;
-						}
-						return color;
-						};
-
-					Color3 color1 = getColor(t1);
-					Color3 color2 = getColor(t2);
-
-					float brightness1 = (1.0f - t1 * 0.65f) * layerAlpha * sideAlpha;
-					float brightness2 = (1.0f - t2 * 0.65f) * layerAlpha * sideAlpha;
-
-					glBegin(GL_QUAD_STRIP);
-					for (int i = 0; i <= numSegments; i++) {
-						float angle = (i / (float)numSegments) * 2.0f * (float)M_PI + bh.diskRotationAngle;
-						float cosA = cos(angle);
-						float sinA = sin(angle);
-
-						float yOffset1, yOffset2;
-						if (side == 0) {
-							yOffset1 = -t1 * t1 * innerRadius1 * 0.05f;
-							yOffset2 = -t2 * t2 * innerRadius2 * 0.05f;
-						}
-						else {
-							float warp1 = (1.0f - t1) * (1.0f - t1);
-							float warp2 = (1.0f - t2) * (1.0f - t2);
-							float puff1 = (t1 > 0.6f) ? pow((t1 - 0.6f) / 0.4f, 1.5f) * 2.0f : 0.0f;
-							float puff2 = (t2 > 0.6f) ? pow((t2 - 0.6f) / 0.4f, 1.5f) * 2.0f : 0.0f;
-							yOffset1 = warp1 * innerRadius1 * 0.3f + puff1 * innerRadius1 * 0.15f;
-							yOffset2 = warp2 * innerRadius2 * 0.3f + puff2 * innerRadius2 * 0.15f;
-						}
-
-						float dopplerFactor = 1.0f + 0.5f * cosA;
-						if (side == 1) dopplerFactor = 1.0f + 0.2f * cosA;
-
-						glColor4f(color1.r * brightness1 * dopplerFactor,
-							color1.g * brightness1 * dopplerFactor,
-							color1.b * brightness1 * dopplerFactor,
-							brightness1);
-						glVertex3f(innerRadius1 * cosA, yOffset1, innerRadius1 * sinA);
-
-						glColor4f(color2.r * brightness2 * dopplerFactor,
-							color2.g * brightness2 * dopplerFactor,
-							color2.b * brightness2 * dopplerFactor,
-							brightness2);
-						glVertex3f(innerRadius2 * cosA, yOffset2, innerRadius2 * sinA);
-					}
-					glEnd();
-				}
-			}
-		}
+const float BLACK_HOLE_VISUAL_SCALE = 1.5f;
 
-		// relativistic jets
-		float jetLength = bh.accretionDiskOuterRadius * visualScale * 2.0f;
-		float jetWidth = bh.accretionDiskInnerRadius * visualScale * 0.25f;
+static float diskLayerAlpha(int layer) {
+	return (layer == 0) ? 0.9f : (layer == 1) ? 0.5f : (layer == 2) ? 0.25f : 0.12f;
+}
 
-		int jetLayers, jetSegments;
-		if (highQuality) {
-			jetLayers = 4;
-			jetSegments = 24;
-		}
-		else if (mediumQuality) {
-			jetLayers = 3;
-			jetSegments = 16;
-		}
-		else {
-			jetLayers = 2;
-			jetSegments = 12;
-		}
+static float jetLayerAlpha(int jetLayer) {
+	return (jetLayer == 0) ? 0.9f : (jetLayer == 1) ? 0.6f : (jetLayer == 2) ? 0.3f : 0.15f;
+}
 
-		for (int jetLayer = 0; jetLayer < jetLayers; jetLayer++) {
-			float jetAlpha = (jetLayer == 0) ? 0.9f : (jetLayer == 1) ? 0.6f : (jetLayer == 2) ? 0.3f : 0.15f;
-			float jetScale = 1.0f + (float)jetLayer * 0.2f;
-
-			float greenR = (jetLayer == 0) ? 0.2f : 0.3f;
-			float greenG = (jetLayer == 0) ? 1.0f : 0.9f;
-			float greenB = (jetLayer == 0) ? 0.4f : 0.5f;
-
-			glBegin(GL_TRIANGLE_FAN);
-			glColor4f(greenR, greenG, greenB, jetAlpha);
-			glVertex3f(0.0f, jetLength * jetScale, 0.0f);
-			glColor4f(greenR * 0.5f, greenG * 0.5f, greenB * 0.5f, 0.0f);
-			for (int i = 0; i <= jetSegments; i++) {
-				float angle = (i / (float)jetSegments) * 2.0f * (float)M_PI;
-				glVertex3f(jetWidth * jetScale * cos(angle),
-					jetLength * 0.15f,
-					jetWidth * jetScale * sin(angle));
+// the disk's height above (side 0: below) its plane at t, for a ring of the given radius
+static float diskYOffset(int side, float t, float radius) {
+	if (side == 0) {
+		return -t * t * radius * 0.05f;
+	}
+	float warp = (1.0f - t) * (1.0f - t);
+	float puff = (t > 0.6f) ? pow((t - 0.6f) / 0.4f, 1.5f) * 2.0f : 0.0f;
+	return warp * radius * 0.3f + puff * radius * 0.15f;
+}
+
+static bool blackHoleVisible(const BlackHole& bh) {
+	// the jets reach furthest, everything else but the glow sprites sits inside them
+	// the glow is in pixels, so it's tested as a point at its largest (12 layer) size
+	float boundingRadius = bh.accretionDiskOuterRadius * BLACK_HOLE_VISUAL_SCALE * 2.0f * 1.6f;
+	float maxGlowSize = bh.eventHorizonRadius * BLACK_HOLE_VISUAL_SCALE * 2.5f * (1.0f + 11.0f * 0.3f);
+	return g_cameraView.frustum.sphereVisible(bh.x, bh.y, bh.z, boundingRadius) ||
+		g_cameraView.pointVisible(bh.x, bh.y, bh.z, maxGlowSize);
+}
+
+// immediate mode for the fixed-function backend, the disk is rebuilt every frame
+static void renderBlackHoleLegacy(const BlackHole& bh, const BlackHoleQuality& q) {
+	static VertexBatch batch;
+	const float visualScale = BLACK_HOLE_VISUAL_SCALE;
+
+	// accretion disk
+	for (int layer = 0; layer < q.diskLayers; layer++) {
+		float layerAlpha = diskLayerAlpha(layer);
+		float layerScale = 1.0f + (float)layer * 0.2f;
+
+		for (int side = 0; side < 2; side++) {
+			float sideAlpha = (side == 0) ? 1.0f : 0.6f;
+
+			for (int ring = 0; ring < q.diskRings - 1; ring++) {
+				float t1 = ring / (float)q.diskRings;
+				float t2 = (ring + 1) / (float)q.diskRings;
+
+				float innerRadius1 = (bh.accretionDiskInnerRadius +
+					t1 * (bh.accretionDiskOuterRadius - bh.accretionDiskInnerRadius))
+					* visualScale * layerScale;
+				float innerRadius2 = (bh.accretionDiskInnerRadius +
+					t2 * (bh.accretionDiskOuterRadius - bh.accretionDiskInnerRadius))
+					* visualScale * layerScale;
+
+				Color3 color1 = diskColor(t1);
+				Color3 color2 = diskColor(t2);
+
+				float brightness1 = (1.0f - t1 * 0.65f) * layerAlpha * sideAlpha;
+				float brightness2 = (1.0f - t2 * 0.65f) * layerAlpha * sideAlpha;
+
+				float yOffset1 = diskYOffset(side, t1, innerRadius1);
+				float yOffset2 = diskYOffset(side, t2, innerRadius2);
+
+				batch.begin(GL_QUAD_STRIP);
+				for (int i = 0; i <= q.diskSegments; i++) {
+					OrbitalPhase segmentPhase = (OrbitalPhase)(((uint64_t)i << 32) / q.diskSegments) + bh.diskRotationPhase;
+					float sinA, cosA;
+					phaseSinCos(segmentPhase, sinA, cosA);
+
+					float dopplerFactor = 1.0f + 0.5f * cosA;
+					if (side == 1) dopplerFactor = 1.0f + 0.2f * cosA;
+
+					batch.color(color1.r * brightness1 * dopplerFactor,
+						color1.g * brightness1 * dopplerFactor,
+						color1.b * brightness1 * dopplerFactor,
+						brightness1);
+					batch.vertex(innerRadius1 * cosA, yOffset1, innerRadius1 * sinA);
+
+					batch.color(color2.r * brightness2 * dopplerFactor,
+						color2.g * brightness2 * dopplerFactor,
+						color2.b * brightness2 * dopplerFactor,
+						brightness2);
+					batch.vertex(innerRadius2 * cosA, yOffset2, innerRadius2 * sinA);
+				}
+				batch.end();
 			}
-			glEnd();
-
-			glBegin(GL_TRIANGLE_FAN);
-			glColor4f(greenR, greenG, greenB, jetAlpha);
-			glVertex3f(0.0f, -jetLength * jetScale, 0.0f);
-			glColor4f(greenR * 0.5f, greenG * 0.5f, greenB * 0.5f, 0.0f);
-			for (int i = 0; i <= jetSegments; i++) {
-				float angle = (i / (float)jetSegments) * 2.0f * (float)M_PI;
-				glVertex3f(jetWidth * jetScale * cos(angle),
-					-jetLength * 0.15f,
+		}
+	}
+
+	// relativistic jets
+	float jetLength = bh.accretionDiskOuterRadius * visualScale * 2.0f;
+	float jetWidth = bh.accretionDiskInnerRadius * visualScale * 0.25f;
+
+	for (int jetLayer = 0; jetLayer < q.jetLayers; jetLayer++) {
+		float jetAlpha = jetLayerAlpha(jetLayer);
+		float jetScale = 1.0f + (float)jetLayer * 0.2f;
+
+		float greenR = (jetLayer == 0) ? 0.2f : 0.3f;
+		float greenG = (jetLayer == 0) ? 1.0f : 0.9f;
+		float greenB = (jetLayer == 0) ? 0.4f : 0.5f;
+
+		for (float direction : { 1.0f, -1.0f }) {
+			batch.begin(GL_TRIANGLE_FAN);
+			batch.color(greenR, greenG, greenB, jetAlpha);
+			batch.vertex(0.0f, direction * jetLength * jetScale, 0.0f);
+			batch.color(greenR * 0.5f, greenG * 0.5f, greenB * 0.5f, 0.0f);
+			for (int i = 0; i <= q.jetSegments; i++) {
+				float angle = (i / (float)q.jetSegments) * 2.0f * (float)M_PI;
+				batch.vertex(jetWidth * jetScale * cos(angle),
+					direction * jetLength * 0.15f,
 					jetWidth * jetScale * sin(angle));
 			}
-			glEnd();
+			batch.end();
 		}
+	}
 
-		// photon sphere / gravitational lensing
-		float photonSphereRadius = bh.eventHorizonRadius * visualScale * 1.5f;
+	// disk and jets go out in one draw
+	batch.draw();
 
-		int numLensRings, lensSegments;
-		if (highQuality) {
-			numLensRings = 8;
-			lensSegments = 64;
-		}
-		else if (mediumQuality) {
-			numLensRings = 4;
-			lensSegments = 32;
-		}
-		else {
-			numLensRings = 2;
-			lensSegments = 24;
+	// photon sphere / gravitational lensing
+	float photonSphereRadius = bh.eventHorizonRadius * visualScale * 1.5f;
+
+	for (int lensLayer = 0; lensLayer < q.lensRings; lensLayer++) {
+		float lensRadius = photonSphereRadius * (1.0f + (float)lensLayer * 0.15f);
+		float lensAlpha = 0.6f / (1.0f + (float)lensLayer * 0.6f);
+		float lensWidth = 3.0f + (float)lensLayer * 0.8f;
+
+		glLineWidth(lensWidth);
+		batch.begin(GL_LINE_LOOP);
+		batch.color(1.0f, 0.95f, 0.7f, lensAlpha);
+		for (int i = 0; i < q.lensSegments; i++) {
+			float angle = (i / (float)q.lensSegments) * 2.0f * (float)M_PI;
+			batch.vertex(lensRadius * cos(angle), 0.0f, lensRadius * sin(angle));
 		}
+		batch.end();
+		batch.draw();
+	}
+	glLineWidth(1.0f);
 
-		for (int lensLayer = 0; lensLayer < numLensRings; lensLayer++) {
-			float lensRadius = photonSphereRadius * (1.0f + (float)lensLayer * 0.15f);
-			float lensAlpha = 0.6f / (1.0f + (float)lensLayer * 0.6f);
-			float lensWidth = 3.0f + (float)lensLayer * 0.8f;
-
-			glLineWidth(lensWidth);
-			glBegin(GL_LINE_LOOP);
-			glColor4f(1.0f, 0.95f, 0.7f, lensAlpha);
-			for (int i = 0; i < lensSegments; i++) {
-				float angle = (i / (float)lensSegments) * 2.0f * (float)M_PI;
-				glVertex3f(lensRadius * cos(angle), 0.0f, lensRadius * sin(angle));
-			}
-			glEnd();
+	// event horizon shadow
+	float shadowRadius = bh.eventHorizonRadius * visualScale * 2.5f;
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	batch.color(0.0f, 0.0f, 0.0f, 1.0f);
+
+	for (int lat = 0; lat < q.latSegments; lat++) {
+		float theta1 = lat * M_PI / q.latSegments;
+		float theta2 = (lat + 1) * M_PI / q.latSegments;
+
+		batch.begin(GL_QUAD_STRIP);
+		for (int lon = 0; lon <= q.lonSegments; lon++) {
+			float phi = lon * 2.0f * M_PI / q.lonSegments;
+
+			batch.vertex(shadowRadius * sin(theta1) * cos(phi), shadowRadius * cos(theta1), shadowRadius * sin(theta1) * sin(phi));
+			batch.vertex(shadowRadius * sin(theta2) * cos(phi), shadowRadius * cos(theta2), shadowRadius * sin(theta2) * sin(phi));
 		}
-		glLineWidth(1.0f); 
+		batch.end();
+	}
+	batch.draw();
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+	// glow around event horizon
+	for (int i = 0; i < q.glowLayers; i++) {
+		float glowSize = shadowRadius * (1.0f + (float)i * 0.3f);
+		float glowAlpha = 0.25f / (1.0f + (float)i * 0.5f);
+
+		glPointSize(glowSize);
+		batch.begin(GL_POINTS);
+		batch.color(1.0f, 0.85f, 0.5f, glowAlpha);
+		batch.vertex(0.0f, 0.0f, 0.0f);
+		batch.end();
+		batch.draw();
+	}
+}
+
+// the modern backend builds every quality level of a black hole once into a static
+// buffer. the disk is stored at phase 0 and turned by the shader, which also looks its
+// colour up in a ramp texture and applies the doppler brightening in world space
+struct BlackHoleVertex {
+	float x, y, z;
+	float r, g, b, a;	// scales the ramp colour on the disk
+	float ramp;			// disk t, negative for parts without the ramp
+	float doppler;		// brightening towards +x, 0 for parts that don't have it
+	float pointSize;	// glow sprites only
+};
+
+struct BlackHoleRange {
+	GLint first = 0;
+	GLsizei count = 0;
+};
+
+struct BlackHoleLodMesh {
+	BlackHoleRange disk;	// in the index buffer
+	BlackHoleRange jets;
+	BlackHoleRange lens;	// lensRings loops of lensSegments vertices
+	BlackHoleRange shadow;
+	BlackHoleRange glow;
+};
+
+struct BlackHoleMesh {
+	// what it was built for, a new mass regenerates it
+	float eventHorizonRadius = 0.0f;
+	float diskInnerRadius = 0.0f;
+	float diskOuterRadius = 0.0f;
+
+	GLuint vao = 0, vbo = 0, ibo = 0;
+	BlackHoleLodMesh lods[NUM_BLACK_HOLE_QUALITIES];
+};
+
+static std::vector<BlackHoleMesh> blackHoleMeshes;
+
+const int DISK_RAMP_SIZE = 256;
+
+static GLuint blackHoleProgram = 0;
+static GLint blackHoleMvpLocation = -1;
+static GLint blackHoleRotationLocation = -1;
+static GLint blackHoleRampLocation = -1;
+static GLint blackHoleViewportLocation = -1;
+static GLint blackHoleRoundPointsLocation = -1;
+static GLuint diskRampTexture = 0;
+
+static const char* BLACK_HOLE_VERTEX_SHADER = R"(#version 330 core
+in vec3 aPosition;
+in vec4 aColor;
+in float aRamp;
+in float aDoppler;
+in float aPointSize;
+
+uniform mat4 uMVP;
+uniform vec2 uRotation;		// cos, sin of the disk's phase
+uniform sampler1D uRamp;
+uniform vec4 uViewport;
+
+out vec4 vColor;
+flat out vec2 vPointCenter;
+flat out float vPointSize;
+
+const float RAMP_SIZE = 256.0;
 
-		// event horizon shadow
-		float shadowRadius = bh.eventHorizonRadius * visualScale * 2.5f;
+void main() {
+	// turning about +Y by the phase moves x towards z, like the disk's orbit
+	vec3 position = vec3(aPosition.x * uRotation.x - aPosition.z * uRotation.y, aPosition.y,
+		aPosition.x * uRotation.y + aPosition.z * uRotation.x);
 
-		int latSegments, lonSegments;
-		if (highQuality) {
-			latSegments = 24;
-			lonSegments = 32;
+	vec3 color = aColor.rgb;
+	if (aRamp >= 0.0) {
+		color *= texture(uRamp, (aRamp * (RAMP_SIZE - 1.0) + 0.5) / RAMP_SIZE).rgb;
+	}
+	float radius = length(position.xz);
+	float doppler = 1.0 + aDoppler * (radius > 0.0 ? position.x / radius : 0.0);
+
+	vColor = vec4(color * doppler, aColor.a);
+	gl_Position = uMVP * vec4(position, 1.0);
+	gl_PointSize = aPointSize;
+	vPointCenter = (gl_Position.xy / gl_Position.w * 0.5 + 0.5) * uViewport.zw + uViewport.xy;
+	vPointSize = aPointSize;
+}
+)";
+
+static const char* BLACK_HOLE_FRAGMENT_SHADER = R"(#version 330 core
+in vec4 vColor;
+flat in vec2 vPointCenter;
+flat in float vPointSize;
+
+uniform bool uRoundPoints;
+
+out vec4 fragColor;
+
+void main() {
+	float alpha = vColor.a;
+
+	// GL_POINT_SMOOTH's disc, the same as the batch program's
+	if (uRoundPoints) {
+		float coverage = clamp(vPointSize * 0.5 - length(gl_FragCoord.xy - vPointCenter) + 0.5, 0.0, 1.0);
+		if (coverage <= 0.0) discard;
+		alpha *= coverage;
+	}
+
+	// clamped as an 8-bit framebuffer would, the bloom layer is half float
+	fragColor = vec4(clamp(vColor.rgb, 0.0, 1.0), alpha);
+}
+)";
+
+static bool initBlackHoleProgram() {
+	blackHoleProgram = createShaderProgram("black hole", BLACK_HOLE_VERTEX_SHADER, BLACK_HOLE_FRAGMENT_SHADER,
+		{ "aPosition", "aColor", "aRamp", "aDoppler", "aPointSize" });
+	if (!blackHoleProgram) return false;
+
+	blackHoleMvpLocation = glGetUniformLocation(blackHoleProgram, "uMVP");
+	blackHoleRotationLocation = glGetUniformLocation(blackHoleProgram, "uRotation");
+	blackHoleRampLocation = glGetUniformLocation(blackHoleProgram, "uRamp");
+	blackHoleViewportLocation = glGetUniformLocation(blackHoleProgram, "uViewport");
+	blackHoleRoundPointsLocation = glGetUniformLocation(blackHoleProgram, "uRoundPoints");
+
+	// diskColor sampled at texel centres, linear filtering fills in between
+	unsigned char ramp[DISK_RAMP_SIZE * 3];
+	for (int i = 0; i < DISK_RAMP_SIZE; i++) {
+		Color3 color = diskColor(i / (float)(DISK_RAMP_SIZE - 1));
+		ramp[i * 3 + 0] = (unsigned char)(color.r * 255.0f + 0.5f);
+		ramp[i * 3 + 1] = (unsigned char)(color.g * 255.0f + 0.5f);
+		ramp[i * 3 + 2] = (unsigned char)(color.b * 255.0f + 0.5f);
+	}
+
+	glGenTextures(1, &diskRampTexture);
+	glBindTexture(GL_TEXTURE_1D, diskRampTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB8, DISK_RAMP_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, ramp);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D, 0);
+	return true;
+}
+
+// one quality level's geometry, appended to the black hole's buffers
+static void buildBlackHoleLod(const BlackHole& bh, const BlackHoleQuality& q, BlackHoleLodMesh& lod,
+	std::vector<BlackHoleVertex>& vertices, std::vector<GLuint>& indices) {
+	const float visualScale = BLACK_HOLE_VISUAL_SCALE;
+	auto range = [&](BlackHoleRange& r, size_t first, size_t end) {
+		r.first = (GLint)first;
+		r.count = (GLsizei)(end - first);
+	};
+
+	// accretion disk: numRings rows of the quad strips the legacy path draws, shared
+	// between neighbouring rings and indexed in the same triangle order
+	size_t firstIndex = indices.size();
+	for (int layer = 0; layer < q.diskLayers; layer++) {
+		float layerAlpha = diskLayerAlpha(layer);
+		float layerScale = 1.0f + (float)layer * 0.2f;
+
+		for (int side = 0; side < 2; side++) {
+			float sideAlpha = (side == 0) ? 1.0f : 0.6f;
+			GLuint rowsStart = (GLuint)vertices.size();
+			const GLuint rowLength = q.diskSegments + 1;
+
+			for (int ring = 0; ring < q.diskRings; ring++) {
+				float t = ring / (float)q.diskRings;
+				float radius = (bh.accretionDiskInnerRadius +
+					t * (bh.accretionDiskOuterRadius - bh.accretionDiskInnerRadius))
+					* visualScale * layerScale;
+				float brightness = (1.0f - t * 0.65f) * layerAlpha * sideAlpha;
+				float yOffset = diskYOffset(side, t, radius);
+
+				for (int i = 0; i <= q.diskSegments; i++) {
+					OrbitalPhase segmentPhase = (OrbitalPhase)(((uint64_t)i << 32) / q.diskSegments);
+					float sinA, cosA;
+					phaseSinCos(segmentPhase, sinA, cosA);
+					vertices.push_back({ radius * cosA, yOffset, radius * sinA,
+						brightness, brightness, brightness, brightness,
+						t, (side == 0) ? 0.5f : 0.2f, 0.0f });
+				}
+			}
+
+			for (int ring = 0; ring < q.diskRings - 1; ring++) {
+				GLuint inner = rowsStart + ring * rowLength;
+				GLuint outer = inner + rowLength;
+				for (int i = 1; i <= q.diskSegments; i++) {
+					indices.insert(indices.end(), { inner + i - 1, outer + i - 1, outer + i,
+						inner + i - 1, outer + i, inner + i });
+				}
+			}
 		}
-		else if (mediumQuality) {
-			latSegments = 16;
-			lonSegments = 24;
+	}
+	range(lod.disk, firstIndex, indices.size());
+
+	// relativistic jets, the fans as triangles
+	float jetLength = bh.accretionDiskOuterRadius * visualScale * 2.0f;
+	float jetWidth = bh.accretionDiskInnerRadius * visualScale * 0.25f;
+
+	size_t first = vertices.size();
+	for (int jetLayer = 0; jetLayer < q.jetLayers; jetLayer++) {
+		float jetAlpha = jetLayerAlpha(jetLayer);
+		float jetScale = 1.0f + (float)jetLayer * 0.2f;
+
+		float greenR = (jetLayer == 0) ? 0.2f : 0.3f;
+		float greenG = (jetLayer == 0) ? 1.0f : 0.9f;
+		float greenB = (jetLayer == 0) ? 0.4f : 0.5f;
+
+		for (float direction : { 1.0f, -1.0f }) {
+			BlackHoleVertex tip = { 0.0f, direction * jetLength * jetScale, 0.0f,
+				greenR, greenG, greenB, jetAlpha, -1.0f, 0.0f, 0.0f };
+			BlackHoleVertex previous = {};
+			for (int i = 0; i <= q.jetSegments; i++) {
+				float angle = (i / (float)q.jetSegments) * 2.0f * (float)M_PI;
+				BlackHoleVertex rim = { (float)(jetWidth * jetScale * cos(angle)), direction * jetLength * 0.15f,
+					(float)(jetWidth * jetScale * sin(angle)),
+					greenR * 0.5f, greenG * 0.5f, greenB * 0.5f, 0.0f, -1.0f, 0.0f, 0.0f };
+				if (i > 0) vertices.insert(vertices.end(), { tip, previous, rim });
+				previous = rim;
+			}
 		}
-		else {
-			latSegments = 12;
-			lonSegments = 16;
+	}
+	range(lod.jets, first, vertices.size());
+
+	// photon sphere / gravitational lensing
+	float photonSphereRadius = bh.eventHorizonRadius * visualScale * 1.5f;
+
+	first = vertices.size();
+	for (int lensLayer = 0; lensLayer < q.lensRings; lensLayer++) {
+		float lensRadius = photonSphereRadius * (1.0f + (float)lensLayer * 0.15f);
+		float lensAlpha = 0.6f / (1.0f + (float)lensLayer * 0.6f);
+		for (int i = 0; i < q.lensSegments; i++) {
+			float angle = (i / (float)q.lensSegments) * 2.0f * (float)M_PI;
+			vertices.push_back({ (float)(lensRadius * cos(angle)), 0.0f, (float)(lensRadius * sin(angle)),
+				1.0f, 0.95f, 0.7f, lensAlpha, -1.0f, 0.0f, 0.0f });
 		}
+	}
+	range(lod.lens, first, vertices.size());
+
+	// event horizon shadow, the quad strips as triangles
+	float shadowRadius = bh.eventHorizonRadius * visualScale * 2.5f;
+
+	first = vertices.size();
+	auto shadowVertex = [&](float theta, float phi) -> BlackHoleVertex {
+		return { (float)(shadowRadius * sin(theta) * cos(phi)), (float)(shadowRadius * cos(theta)),
+			(float)(shadowRadius * sin(theta) * sin(phi)),
+			0.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f };
+	};
+	for (int lat = 0; lat < q.latSegments; lat++) {
+		float theta1 = lat * M_PI / q.latSegments;
+		float theta2 = (lat + 1) * M_PI / q.latSegments;
+
+		for (int lon = 1; lon <= q.lonSegments; lon++) {
+			float phi0 = (lon - 1) * 2.0f * M_PI / q.lonSegments;
+			float phi1 = lon * 2.0f * M_PI / q.lonSegments;
+			BlackHoleVertex a = shadowVertex(theta1, phi0), b = shadowVertex(theta2, phi0);
+			BlackHoleVertex c = shadowVertex(theta2, phi1), d = shadowVertex(theta1, phi1);
+			vertices.insert(vertices.end(), { a, b, c, a, c, d });
+		}
+	}
+	range(lod.shadow, first, vertices.size());
+
+	// glow around event horizon, sized in pixels
+	first = vertices.size();
+	for (int i = 0; i < q.glowLayers; i++) {
+		float glowSize = shadowRadius * (1.0f + (float)i * 0.3f);
+		float glowAlpha = 0.25f / (1.0f + (float)i * 0.5f);
+		vertices.push_back({ 0.0f, 0.0f, 0.0f, 1.0f, 0.85f, 0.5f, glowAlpha, -1.0f, 0.0f, glowSize });
+	}
+	range(lod.glow, first, vertices.size());
+}
 
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glColor4f(0.0f, 0.0f, 0.0f, 1.0f);
+static void buildBlackHoleMesh(const BlackHole& bh, BlackHoleMesh& mesh) {
+	std::vector<BlackHoleVertex> vertices;
+	std::vector<GLuint> indices;
+	for (int level = 0; level < NUM_BLACK_HOLE_QUALITIES; level++) {
+		buildBlackHoleLod(bh, BLACK_HOLE_QUALITIES[level], mesh.lods[level], vertices, indices);
+	}
+
+	if (!mesh.vao) {
+		glGenVertexArrays(1, &mesh.vao);
+		glGenBuffers(1, &mesh.vbo);
+		glGenBuffers(1, &mesh.ibo);
+
+		glBindVertexArray(mesh.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BlackHoleVertex), (const void*)offsetof(BlackHoleVertex, x));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(BlackHoleVertex), (const void*)offsetof(BlackHoleVertex, r));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(BlackHoleVertex), (const void*)offsetof(BlackHoleVertex, ramp));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(BlackHoleVertex), (const void*)offsetof(BlackHoleVertex, doppler));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(BlackHoleVertex), (const void*)offsetof(BlackHoleVertex, pointSize));
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BlackHoleVertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	mesh.eventHorizonRadius = bh.eventHorizonRadius;
+	mesh.diskInnerRadius = bh.accretionDiskInnerRadius;
+	mesh.diskOuterRadius = bh.accretionDiskOuterRadius;
+}
+
+// LAYERED is the whole overdrawn look. with bloom the frame gets the SHADOW alone, and
+// the bloom layer one layer of each part with the shadow hiding what's behind it
+enum class BlackHolePass {
+	LAYERED,
+	SHADOW,
+	BLOOM_LAYER
+};
+
+// how much of the blurred layer goes on top of the sharp one, about what the extra
+// disk and jet layers used to add
+const float BLACK_HOLE_BLOOM_STRENGTH = 0.25f;
 
-		for (int lat = 0; lat < latSegments; lat++) {
-			float theta1 = lat * M_PI / latSegments;
-			float theta2 = (lat + 1) * M_PI / latSegments;
+static void renderBlackHoleModern(const BlackHole& bh, BlackHoleMesh& mesh, const BlackHoleQuality& q,
+	const BlackHoleLodMesh& lod, BlackHolePass pass, bool lensed) {
+	float mvp[16];
+	getModelViewProjection(mvp);
 
-			glBegin(GL_QUAD_STRIP);
-			for (int lon = 0; lon <= lonSegments; lon++) {
-				float phi = lon * 2.0f * M_PI / lonSegments;
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
 
-				float x1 = shadowRadius * sin(theta1) * cos(phi);
-				float y1 = shadowRadius * cos(theta1);
-				float z1 = shadowRadius * sin(theta1) * sin(phi);
+	float sinPhase, cosPhase;
+	phaseSinCos(bh.diskRotationPhase, sinPhase, cosPhase);
 
-				float x2 = shadowRadius * sin(theta2) * cos(phi);
-				float y2 = shadowRadius * cos(theta2);
-				float z2 = shadowRadius * sin(theta2) * sin(phi);
+	glUseProgram(blackHoleProgram);
+	glUniformMatrix4fv(blackHoleMvpLocation, 1, GL_FALSE, mvp);
+	glUniform4f(blackHoleViewportLocation, (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+	glUniform1i(blackHoleRoundPointsLocation, glIsEnabled(GL_POINT_SMOOTH) ? 1 : 0);
+	glUniform1i(blackHoleRampLocation, 0);
+	glUniform2f(blackHoleRotationLocation, 1.0f, 0.0f);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_1D, diskRampTexture);
+	glBindVertexArray(mesh.vao);
 
-				glVertex3f(x1, y1, z1);
-				glVertex3f(x2, y2, z2);
+	if (pass == BlackHolePass::SHADOW) {
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDrawArrays(GL_TRIANGLES, lod.shadow.first, lod.shadow.count);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	}
+	else {
+		// every part is built layer by layer, the innermost first
+		bool layered = pass == BlackHolePass::LAYERED;
+		GLsizei diskCount = layered ? lod.disk.count : lod.disk.count / q.diskLayers;
+		GLsizei jetCount = layered ? lod.jets.count : lod.jets.count / q.jetLayers;
+		int lensRings = layered ? q.lensRings : 1;
+		GLsizei glowCount = layered ? lod.glow.count : 1;
+
+		// only the disk turns, the rest is drawn as built
+		glUniform2f(blackHoleRotationLocation, cosPhase, sinPhase);
+		glDrawElements(GL_TRIANGLES, diskCount, GL_UNSIGNED_INT, (const void*)(lod.disk.first * sizeof(GLuint)));
+		glUniform2f(blackHoleRotationLocation, 1.0f, 0.0f);
+		glDrawArrays(GL_TRIANGLES, lod.jets.first, jetCount);
+
+		// the photon rings stand in for lensing when the lensing pass can't run
+		if (!lensed) {
+			for (int lensLayer = 0; lensLayer < lensRings; lensLayer++) {
+				glLineWidth(3.0f + (float)lensLayer * 0.8f);
+				glDrawArrays(GL_LINE_LOOP, lod.lens.first + lensLayer * q.lensSegments, q.lensSegments);
 			}
-			glEnd();
+			glLineWidth(1.0f);
 		}
 
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDrawArrays(GL_TRIANGLES, lod.shadow.first, lod.shadow.count);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-		// glow around event horizon
-		int numGlowLayers;
-		if (highQuality) {
-			numGlowLayers = 12;
-		}
-		else if (mediumQuality) {
-			numGlowLayers = 6;
-		}
-		else {
-			numGlowLayers = 3;
-		}
+		glEnable(GL_PROGRAM_POINT_SIZE);
+		glDrawArrays(GL_POINTS, lod.glow.first, glowCount);
+		glDisable(GL_PROGRAM_POINT_SIZE);
+	}
 
-		for (int i = 0; i < numGlowLayers; i++) {
-			float glowSize = shadowRadius * (1.0f + (float)i * 0.3f);
-			float glowAlpha = 0.25f / (1.0f + (float)i * 0.5f);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_1D, 0);
+	glUseProgram(0);
+}
 
-			glPointSize(glowSize);
-			glBegin(GL_POINTS);
-			glColor4f(1.0f, 0.85f, 0.5f, glowAlpha);
-			glVertex3f(0.0f, 0.0f, 0.0f);
-			glEnd();
+// the meshes for this frame's black holes, built or rebuilt as needed
+static void updateBlackHoleMeshes(const std::vector<BlackHole>& blackHoles) {
+	for (size_t i = blackHoles.size(); i < blackHoleMeshes.size(); i++) {
+		const BlackHoleMesh& mesh = blackHoleMeshes[i];
+		if (!mesh.vao) continue;
+		glDeleteVertexArrays(1, &mesh.vao);
+		glDeleteBuffers(1, &mesh.vbo);
+		glDeleteBuffers(1, &mesh.ibo);
+	}
+	blackHoleMeshes.resize(blackHoles.size());
+
+	for (size_t i = 0; i < blackHoles.size(); i++) {
+		const BlackHole& bh = blackHoles[i];
+		BlackHoleMesh& mesh = blackHoleMeshes[i];
+		if (!mesh.vao || mesh.eventHorizonRadius != bh.eventHorizonRadius ||
+			mesh.diskInnerRadius != bh.accretionDiskInnerRadius || mesh.diskOuterRadius != bh.accretionDiskOuterRadius) {
+			buildBlackHoleMesh(bh, mesh);
 		}
+	}
+}
 
+static void renderBlackHolesModern(const std::vector<BlackHole>& blackHoles, int level, BlackHolePass pass, bool lensed) {
+	const BlackHoleQuality& quality = BLACK_HOLE_QUALITIES[level];
+	for (size_t i = 0; i < blackHoles.size(); i++) {
+		const BlackHole& bh = blackHoles[i];
+		if (!blackHoleVisible(bh)) continue;
+
+		glPushMatrix();
+		loadCameraRelative(bh.x, bh.y, bh.z);
+		renderBlackHoleModern(bh, blackHoleMeshes[i], quality, blackHoleMeshes[i].lods[level], pass, lensed);
 		glPopMatrix();
 	}
+}
+
+void renderBlackHoles(const std::vector<BlackHole>& blackHoles, const RenderZone& zone) {
+	if (g_renderBackend == RenderBackend::MODERN && !blackHoleProgram && !initBlackHoleProgram()) {
+		std::cout << "Black hole shader unavailable, falling back to the fixed-function renderer" << std::endl;
+		g_renderBackend = RenderBackend::LEGACY;
+	}
+
+	const int level = blackHoleQualityLevel(zone);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+	if (g_renderBackend == RenderBackend::MODERN) {
+		updateBlackHoleMeshes(blackHoles);
+
+		// everything drawn so far is bent around the black holes, their own meshes go on top
+		// the lens is the visual size of the black hole, so its shadow matches the drawn one
+		bool lensed = false;
+		if (!blackHoles.empty()) {
+			static std::vector<Lens> lenses;
+			lenses.clear();
+			for (const BlackHole& bh : blackHoles) {
+				lenses.push_back({ bh.x, bh.y, bh.z, bh.eventHorizonRadius * BLACK_HOLE_VISUAL_SCALE });
+			}
+			lensed = renderLensing(lenses);
+		}
+
+		// a black hole out of view can still bend the stars next to the screen edge, but with
+		// none in view there is nothing to shadow or blur, so the bloom passes are skipped
+		size_t visible = 0;
+		for (const BlackHole& bh : blackHoles) {
+			if (blackHoleVisible(bh)) visible++;
+		}
+
+		// the shadow darkens the frame directly, the glowing parts are blurred into a glow
+		if (visible > 0) {
+			renderBlackHolesModern(blackHoles, level, BlackHolePass::SHADOW, lensed);
+			if (beginBloomLayer()) {
+				renderBlackHolesModern(blackHoles, level, BlackHolePass::BLOOM_LAYER, lensed);
+				endBloomLayer(BLACK_HOLE_BLOOM_STRENGTH);
+			}
+			else {
+				renderBlackHolesModern(blackHoles, level, BlackHolePass::LAYERED, lensed);
+			}
+		}
+	}
+	else {
+		for (const BlackHole& bh : blackHoles) {
+			if (!blackHoleVisible(bh)) continue;
+
+			glPushMatrix();
+			loadCameraRelative(bh.x, bh.y, bh.z);
+			renderBlackHoleLegacy(bh, BLACK_HOLE_QUALITIES[level]);
+			glPopMatrix();
+		}
+	}
 
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
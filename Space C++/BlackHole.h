@@ -1,4 +1,5 @@
 #pragma once
+#include "OrbitalPhase.h"
 #include <vector>
 
 struct RenderZone;
@@ -11,7 +12,7 @@ struct BlackHole {
 	float accretionDiskInnerRadius;
 	float accretionDiskOuterRadius;
 
-	float diskRotationAngle;
+	OrbitalPhase diskRotationPhase;
 	float diskRotationSpeed;
 };
 
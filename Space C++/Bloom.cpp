@@ -0,0 +1,259 @@
+#include "Bloom.h"
+#include "Renderer.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+// the first pyramid level is half the window, every further one half the last,
+// down to about BLOOM_MIN_SIZE pixels on the short side
+const int BLOOM_MAX_LEVELS = 6;
+const int BLOOM_MIN_SIZE = 8;
+
+struct BloomTarget {
+	GLuint framebuffer;
+	GLuint texture;
+	int width, height;
+};
+
+static BloomTarget bloomLayer = { 0, 0, 0, 0 };
+static GLuint bloomLayerDepth = 0;
+static std::vector<BloomTarget> bloomLevels;
+
+static GLuint bloomDownsampleProgram = 0;
+static GLuint bloomUpsampleProgram = 0;
+static GLuint bloomCompositeProgram = 0;
+static GLint bloomDownsampleTexelLocation = -1;
+static GLint bloomUpsampleTexelLocation = -1;
+static GLint bloomCompositeStrengthLocation = -1;
+static GLuint bloomVao = 0;
+static bool bloomFailed = false;
+
+// what beginBloomLayer changed
+static GLint savedViewport[4];
+static GLint savedFramebuffer = 0;
+static GLfloat savedClearColor[4];
+
+// one triangle over the whole viewport, no attributes
+static const char* BLOOM_VERTEX_SHADER = R"(#version 330 core
+out vec2 vUv;
+
+void main() {
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	vUv = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// four bilinear taps a texel off the centre diagonally: a 4x4 box of the source
+static const char* BLOOM_DOWNSAMPLE_FRAGMENT_SHADER = R"(#version 330 core
+in vec2 vUv;
+
+uniform sampler2D uSource;
+uniform vec2 uTexel;
+
+out vec4 fragColor;
+
+void main() {
+	vec3 sum = texture(uSource, vUv + vec2(-uTexel.x, -uTexel.y)).rgb +
+		texture(uSource, vUv + vec2(uTexel.x, -uTexel.y)).rgb +
+		texture(uSource, vUv + vec2(-uTexel.x, uTexel.y)).rgb +
+		texture(uSource, vUv + vec2(uTexel.x, uTexel.y)).rgb;
+	fragColor = vec4(sum * 0.25, 1.0);
+}
+)";
+
+// 3x3 tent over the smaller level, added onto the larger one
+static const char* BLOOM_UPSAMPLE_FRAGMENT_SHADER = R"(#version 330 core
+in vec2 vUv;
+
+uniform sampler2D uSource;
+uniform vec2 uTexel;
+
+out vec4 fragColor;
+
+void main() {
+	vec3 sum = vec3(0.0);
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			float weight = (2.0 - abs(float(x))) * (2.0 - abs(float(y)));
+			sum += texture(uSource, vUv + vec2(x, y) * uTexel).rgb * weight;
+		}
+	}
+	fragColor = vec4(sum / 16.0, 1.0);
+}
+)";
+
+static const char* BLOOM_COMPOSITE_FRAGMENT_SHADER = R"(#version 330 core
+in vec2 vUv;
+
+uniform sampler2D uLayer;
+uniform sampler2D uBloom;
+uniform float uStrength;
+
+out vec4 fragColor;
+
+void main() {
+	fragColor = vec4(texture(uLayer, vUv).rgb + texture(uBloom, vUv).rgb * uStrength, 1.0);
+}
+)";
+
+static GLuint createBloomProgram(const char* name, const char* fragmentSource, const char* samplers[], int numSamplers) {
+	GLuint program = createShaderProgram(name, BLOOM_VERTEX_SHADER, fragmentSource, {});
+	if (!program) return 0;
+
+	glUseProgram(program);
+	for (int i = 0; i < numSamplers; i++) {
+		glUniform1i(glGetUniformLocation(program, samplers[i]), i);
+	}
+	glUseProgram(0);
+	return program;
+}
+
+static bool initBloom() {
+	const char* source[] = { "uSource" };
+	const char* layers[] = { "uLayer", "uBloom" };
+	bloomDownsampleProgram = createBloomProgram("bloom downsample", BLOOM_DOWNSAMPLE_FRAGMENT_SHADER, source, 1);
+	bloomUpsampleProgram = createBloomProgram("bloom upsample", BLOOM_UPSAMPLE_FRAGMENT_SHADER, source, 1);
+	bloomCompositeProgram = createBloomProgram("bloom composite", BLOOM_COMPOSITE_FRAGMENT_SHADER, layers, 2);
+	if (!bloomDownsampleProgram || !bloomUpsampleProgram || !bloomCompositeProgram) return false;
+
+	bloomDownsampleTexelLocation = glGetUniformLocation(bloomDownsampleProgram, "uTexel");
+	bloomUpsampleTexelLocation = glGetUniformLocation(bloomUpsampleProgram, "uTexel");
+	bloomCompositeStrengthLocation = glGetUniformLocation(bloomCompositeProgram, "uStrength");
+
+	// core profiles draw nothing without a vertex array bound, even an empty one
+	glGenVertexArrays(1, &bloomVao);
+	return true;
+}
+
+static bool resizeBloomTarget(BloomTarget& target, int width, int height, GLuint depth) {
+	if (!target.framebuffer) {
+		glGenFramebuffers(1, &target.framebuffer);
+		glGenTextures(1, &target.texture);
+	}
+	target.width = width;
+	target.height = height;
+
+	GLint framebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+	glBindTexture(GL_TEXTURE_2D, target.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+	if (depth) glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	return complete;
+}
+
+// the layer at the window size with its own depth, the pyramid below it
+static bool resizeBloomTargets(int width, int height) {
+	if (width == bloomLayer.width && height == bloomLayer.height) return true;
+
+	if (!bloomLayerDepth) glGenTextures(1, &bloomLayerDepth);
+	glBindTexture(GL_TEXTURE_2D, bloomLayerDepth);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (!resizeBloomTarget(bloomLayer, width, height, bloomLayerDepth)) return false;
+
+	int numLevels = 0;
+	for (int w = width / 2, h = height / 2; numLevels < BLOOM_MAX_LEVELS && std::min(w, h) >= BLOOM_MIN_SIZE; w /= 2, h /= 2) {
+		numLevels++;
+	}
+	for (size_t i = numLevels; i < bloomLevels.size(); i++) {
+		glDeleteFramebuffers(1, &bloomLevels[i].framebuffer);
+		glDeleteTextures(1, &bloomLevels[i].texture);
+	}
+	bloomLevels.resize(numLevels, { 0, 0, 0, 0 });
+	for (int i = 0; i < numLevels; i++) {
+		if (!resizeBloomTarget(bloomLevels[i], std::max(width >> (i + 1), 1), std::max(height >> (i + 1), 1), 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool beginBloomLayer() {
+	if (g_renderBackend != RenderBackend::MODERN || bloomFailed) return false;
+
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	if (!(bloomCompositeProgram || initBloom()) || !resizeBloomTargets(savedViewport[2], savedViewport[3])) {
+		std::cout << "Bloom unavailable, drawing glow as layers" << std::endl;
+		bloomFailed = true;
+		bloomLayer.width = bloomLayer.height = 0;
+		return false;
+	}
+
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, savedClearColor);
+	glBindFramebuffer(GL_FRAMEBUFFER, bloomLayer.framebuffer);
+	glViewport(0, 0, bloomLayer.width, bloomLayer.height);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	return true;
+}
+
+static void drawBloomPass(const BloomTarget& target, GLuint source, int sourceWidth, int sourceHeight, GLint texelLocation) {
+	glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+	glViewport(0, 0, target.width, target.height);
+	glUniform2f(texelLocation, 1.0f / sourceWidth, 1.0f / sourceHeight);
+	glBindTexture(GL_TEXTURE_2D, source);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void endBloomLayer(float strength) {
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(bloomVao);
+	glActiveTexture(GL_TEXTURE0);
+
+	// down the pyramid, each level replacing what it held
+	glDisable(GL_BLEND);
+	glUseProgram(bloomDownsampleProgram);
+	const BloomTarget* source = &bloomLayer;
+	for (const BloomTarget& level : bloomLevels) {
+		drawBloomPass(level, source->texture, source->width, source->height, bloomDownsampleTexelLocation);
+		source = &level;
+	}
+
+	// and back up, every level adding its blur onto the one above, so the first level
+	// ends up with the sum of all the widths
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glUseProgram(bloomUpsampleProgram);
+	for (size_t i = bloomLevels.size(); i-- > 1;) {
+		drawBloomPass(bloomLevels[i - 1], bloomLevels[i].texture, bloomLevels[i].width, bloomLevels[i].height,
+			bloomUpsampleTexelLocation);
+	}
+
+	// the sharp layer plus the averaged widths onto the frame, wherever that was being drawn
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	glClearColor(savedClearColor[0], savedClearColor[1], savedClearColor[2], savedClearColor[3]);
+	glUseProgram(bloomCompositeProgram);
+	glUniform1f(bloomCompositeStrengthLocation, bloomLevels.empty() ? 0.0f : strength / bloomLevels.size());
+	glBindTexture(GL_TEXTURE_2D, bloomLayer.texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, bloomLevels.empty() ? bloomLayer.texture : bloomLevels[0].texture);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+	glBindVertexArray(0);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (!blend) glDisable(GL_BLEND);
+	if (depthTest) glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// glow by blurring instead of overdrawing. additive geometry drawn between
+// beginBloomLayer and endBloomLayer goes into a half-float layer, which is downsampled
+// through a mip pyramid, upsampled back and added to the frame along with the sharp
+// layer. the cost depends on the window size only, not on what's in the layer
+// modern backend only: when beginBloomLayer returns false, draw into the frame as usual
+bool beginBloomLayer();
+
+// strength scales the blurred part against the sharp one
+void endBloomLayer(float strength);
@@ -4,9 +4,37 @@
 #include <GLFW/glfw3.h>
 #include <cmath>
 
+CameraView g_cameraView;
+
+// column-major 4x4 helpers, out = a * b
+static void multiplyMatrices(const double a[16], const double b[16], double out[16]) {
+	double result[16];
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			double sum = 0.0;
+			for (int k = 0; k < 4; k++) {
+				sum += a[k * 4 + row] * b[col * 4 + k];
+			}
+			result[col * 4 + row] = sum;
+		}
+	}
+	for (int i = 0; i < 16; i++) out[i] = result[i];
+}
+
+static void translate(double m[16], double x, double y, double z) {
+	double t[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, y, z, 1 };
+	multiplyMatrices(m, t, m);
+}
+
+static void scale(double m[16], double s) {
+	double t[16] = { s, 0, 0, 0, 0, s, 0, 0, 0, 0, s, 0, 0, 0, 0, 1 };
+	multiplyMatrices(m, t, m);
+}
+
 void setupCamera(const Camera& camera, int width, int height, const SolarSystem& solarSystem) {
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+	CameraView& view = g_cameraView;
+	view.width = width;
+	view.height = height;
 
 	double fov = 45.0;
 	double aspect = (double)width / (double)height;
@@ -20,23 +48,94 @@ void setupCamera(const Camera& camera, int width, int height, const SolarSystem&
 		0, 0, (farPlane + nearPlane) / (nearPlane - farPlane), -1,
 		0, 0, (2 * farPlane * nearPlane) / (nearPlane - farPlane), 0
 	};
-	glLoadMatrixd(projection);
+	for (int i = 0; i < 16; i++) view.projection[i] = projection[i];
+
+	// the position is in zoomed units, in free zoom the scaling pivots on the solar system
+	// either way it comes down to rotate * scale(zoom) * translate(-eye) with the eye in world units
+	if (camera.freeZoomMode) {
+		view.eyeX = solarSystem.centerX + (camera.posX - solarSystem.centerX) / camera.zoom;
+		view.eyeY = solarSystem.centerY + (camera.posY - solarSystem.centerY) / camera.zoom;
+		view.eyeZ = solarSystem.centerZ + (camera.posZ - solarSystem.centerZ) / camera.zoom;
+	} else {
+		view.eyeX = camera.posX / camera.zoom;
+		view.eyeY = camera.posY / camera.zoom;
+		view.eyeZ = camera.posZ / camera.zoom;
+	}
+
+	// pitch about x, then yaw about y
+	double cp = cos(-camera.pitch), sp = sin(-camera.pitch);
+	double cy = cos(-camera.yaw), sy = sin(-camera.yaw);
+	double pitch[16] = { 1, 0, 0, 0, 0, cp, sp, 0, 0, -sp, cp, 0, 0, 0, 0, 1 };
+	double yaw[16] = { cy, 0, -sy, 0, 0, 1, 0, 0, sy, 0, cy, 0, 0, 0, 0, 1 };
+	multiplyMatrices(pitch, yaw, view.relativeView);
+	scale(view.relativeView, camera.zoom);
+
+	for (int i = 0; i < 16; i++) view.view[i] = view.relativeView[i];
+	translate(view.view, -view.eyeX, -view.eyeY, -view.eyeZ);
 
+	multiplyMatrices(view.projection, view.view, view.viewProjection);
+	view.frustum.extract(view.viewProjection);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixd(view.projection);
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+	glLoadMatrixd(view.view);
+}
 
-	glRotated(-camera.pitch * 180.0 / M_PI, 1, 0, 0);
-	glRotated(-camera.yaw * 180.0 / M_PI, 0, 1, 0);
+void Frustum::extract(const double viewProjection[16]) {
+	// Gribb/Hartmann: row 3 plus or minus rows 0-2
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = 0; side < 2; side++) {
+			double* plane = planes[axis * 2 + side];
+			double sign = side == 0 ? 1.0 : -1.0;
+			for (int col = 0; col < 4; col++) {
+				plane[col] = viewProjection[col * 4 + 3] + sign * viewProjection[col * 4 + axis];
+			}
+			double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			if (length > 0.0) {
+				for (int i = 0; i < 4; i++) plane[i] /= length;
+			}
+		}
+	}
+}
 
-	glTranslated(-camera.posX, -camera.posY, -camera.posZ);
+bool Frustum::sphereVisible(double x, double y, double z, double radius) const {
+	for (const double* plane : planes) {
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -radius) return false;
+	}
+	return true;
+}
 
-	if (camera.freeZoomMode) {
-		glTranslated(solarSystem.centerX, solarSystem.centerY, solarSystem.centerZ);
-		glScaled(camera.zoom, camera.zoom, camera.zoom);
-		glTranslated(-solarSystem.centerX, -solarSystem.centerY, -solarSystem.centerZ);
-	} else {
-		glScaled(camera.zoom, camera.zoom, camera.zoom);
+bool Frustum::boxVisible(double minX, double minY, double minZ, double maxX, double maxY, double maxZ) const {
+	// the corner furthest along each plane's normal
+	for (const double* plane : planes) {
+		double x = plane[0] >= 0.0 ? maxX : minX;
+		double y = plane[1] >= 0.0 ? maxY : minY;
+		double z = plane[2] >= 0.0 ? maxZ : minZ;
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0) return false;
 	}
+	return true;
+}
+
+void loadCameraRelative(double x, double y, double z, double scaleFactor) {
+	const CameraView& view = g_cameraView;
+	double modelView[16];
+	for (int i = 0; i < 16; i++) modelView[i] = view.relativeView[i];
+	// the difference is taken in double, only what's left near the eye reaches GL
+	translate(modelView, x - view.eyeX, y - view.eyeY, z - view.eyeZ);
+	scale(modelView, scaleFactor);
+	glLoadMatrixd(modelView);
+}
+
+bool CameraView::pointVisible(double x, double y, double z, double pixelSize) const {
+	const double* m = viewProjection;
+	double clipX = m[0] * x + m[4] * y + m[8] * z + m[12];
+	double clipY = m[1] * x + m[5] * y + m[9] * z + m[13];
+	double clipZ = m[2] * x + m[6] * y + m[10] * z + m[14];
+	double clipW = m[3] * x + m[7] * y + m[11] * z + m[15];
+
+	if (clipW <= 0.0 || fabs(clipZ) > clipW) return false;
+	return fabs(clipX) <= clipW * (1.0 + pixelSize / width) && fabs(clipY) <= clipW * (1.0 + pixelSize / height);
 }
 
 void processInput(GLFWwindow* window, Camera& camera, const UIState* uiState) {
@@ -14,6 +14,38 @@ struct Camera {
     bool freeZoomMode = false;
 };
 
+// clip planes of a view-projection matrix, in world space
+struct Frustum {
+    double planes[6][4];     // normalised, inside where dot(n, p) + d >= 0
+
+    void extract(const double viewProjection[16]);
+    bool sphereVisible(double x, double y, double z, double radius) const;
+    bool boxVisible(double minX, double minY, double minZ, double maxX, double maxY, double maxZ) const;
+};
+
+// the matrices setupCamera loads, kept in double so every renderer can cull on the CPU
+// (column-major like GL, the view includes the zoom)
+struct CameraView {
+    double eyeX = 0.0, eyeY = 0.0, eyeZ = 0.0;   // the camera in world units
+    double relativeView[16];                      // the view with the eye at the origin
+    double view[16];
+    double projection[16];
+    double viewProjection[16];
+    Frustum frustum;
+    int width = 1, height = 1;
+
+    // a point sprite pixelSize wide: GL clips points by their centre, smoothed ones
+    // still show while any part of them is on screen
+    bool pointVisible(double x, double y, double z, double pixelSize) const;
+};
+
+extern CameraView g_cameraView;
+
+// loads a modelview for geometry given relative to (x, y, z) in world units and scaled by
+// scaleFactor. the offset from the eye is taken in double, so nothing jitters at deep zoom
+// the way glTranslate on the float matrix stack does
+void loadCameraRelative(double x, double y, double z, double scaleFactor = 1.0);
+
 struct SolarSystem;
 struct UIState;
 
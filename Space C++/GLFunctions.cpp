@@ -0,0 +1,17 @@
+#include "GLFunctions.h"
+
+#define GL_DEFINE_FUNCTION(ret, name, params) name##Proc galaxy_##name = nullptr;
+GL_FUNCTION_LIST(GL_DEFINE_FUNCTION)
+#undef GL_DEFINE_FUNCTION
+
+bool loadGLFunctions() {
+	bool complete = true;
+
+#define GL_LOAD_FUNCTION(ret, name, params) \
+	galaxy_##name = (name##Proc)glfwGetProcAddress(#name); \
+	if (!galaxy_##name) complete = false;
+	GL_FUNCTION_LIST(GL_LOAD_FUNCTION)
+#undef GL_LOAD_FUNCTION
+
+	return complete;
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <GLFW/glfw3.h>
+#include <cstddef>
+
+// OpenGL 1.1 is all the system headers give us on Windows, everything newer is
+// loaded at runtime through glfwGetProcAddress (see loadGLFunctions)
+
+// glfw3.h undefines APIENTRY again when it defined it, so keep our own
+#if defined(_WIN32) && !defined(_WIN64)
+#define GALAXY_APIENTRY __stdcall
+#else
+#define GALAXY_APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+#ifndef GL_PROGRAM_POINT_SIZE
+#define GL_PROGRAM_POINT_SIZE 0x8642
+#endif
+
+#ifndef GL_POINT_SPRITE
+#define GL_POINT_SPRITE 0x8861
+#endif
+
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0 0x84C0
+#define GL_TEXTURE1 0x84C1
+#endif
+
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#endif
+
+#ifndef GL_FRAMEBUFFER_BINDING
+#define GL_FRAMEBUFFER_BINDING 0x8CA6
+#endif
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+
+#ifndef GL_TEXTURE_CUBE_MAP
+#define GL_TEXTURE_CUBE_MAP 0x8513
+#define GL_TEXTURE_CUBE_MAP_POSITIVE_X 0x8515
+#endif
+
+#ifndef GL_TEXTURE_CUBE_MAP_SEAMLESS
+#define GL_TEXTURE_CUBE_MAP_SEAMLESS 0x884F
+#endif
+
+#ifndef GL_TEXTURE_WRAP_R
+#define GL_TEXTURE_WRAP_R 0x8072
+#endif
+
+#ifndef GL_RGBA16F
+#define GL_RGBA16F 0x881A
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+// every entry point the modern renderers use: return type, name, parameters
+#define GL_FUNCTION_LIST(X) \
+	X(void, glGenBuffers, (GLsizei n, GLuint* buffers)) \
+	X(void, glDeleteBuffers, (GLsizei n, const GLuint* buffers)) \
+	X(void, glBindBuffer, (GLenum target, GLuint buffer)) \
+	X(void, glBufferData, (GLenum target, ptrdiff_t size, const void* data, GLenum usage)) \
+	X(void, glBufferSubData, (GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* data)) \
+	X(void, glGenVertexArrays, (GLsizei n, GLuint* arrays)) \
+	X(void, glDeleteVertexArrays, (GLsizei n, const GLuint* arrays)) \
+	X(void, glBindVertexArray, (GLuint array)) \
+	X(void, glEnableVertexAttribArray, (GLuint index)) \
+	X(void, glDisableVertexAttribArray, (GLuint index)) \
+	X(void, glVertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)) \
+	X(void, glVertexAttribIPointer, (GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer)) \
+	X(void, glVertexAttrib1f, (GLuint index, GLfloat x)) \
+	X(GLuint, glCreateShader, (GLenum type)) \
+	X(void, glShaderSource, (GLuint shader, GLsizei count, const char* const* strings, const GLint* lengths)) \
+	X(void, glCompileShader, (GLuint shader)) \
+	X(void, glGetShaderiv, (GLuint shader, GLenum pname, GLint* params)) \
+	X(void, glGetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei* length, char* infoLog)) \
+	X(void, glDeleteShader, (GLuint shader)) \
+	X(GLuint, glCreateProgram, (void)) \
+	X(void, glAttachShader, (GLuint program, GLuint shader)) \
+	X(void, glBindAttribLocation, (GLuint program, GLuint index, const char* name)) \
+	X(void, glLinkProgram, (GLuint program)) \
+	X(void, glGetProgramiv, (GLuint program, GLenum pname, GLint* params)) \
+	X(void, glGetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei* length, char* infoLog)) \
+	X(void, glDeleteProgram, (GLuint program)) \
+	X(void, glUseProgram, (GLuint program)) \
+	X(GLint, glGetUniformLocation, (GLuint program, const char* name)) \
+	X(void, glUniform1i, (GLint location, GLint v0)) \
+	X(void, glUniform1ui, (GLint location, GLuint v0)) \
+	X(void, glUniform1f, (GLint location, GLfloat v0)) \
+	X(void, glUniform2f, (GLint location, GLfloat v0, GLfloat v1)) \
+	X(void, glUniform1fv, (GLint location, GLsizei count, const GLfloat* value)) \
+	X(void, glUniform2fv, (GLint location, GLsizei count, const GLfloat* value)) \
+	X(void, glUniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)) \
+	X(void, glUniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)) \
+	X(void, glActiveTexture, (GLenum texture)) \
+	X(void, glMultiDrawArrays, (GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount)) \
+	X(void, glVertexAttribDivisor, (GLuint index, GLuint divisor)) \
+	X(void, glDrawArraysInstanced, (GLenum mode, GLint first, GLsizei count, GLsizei instancecount)) \
+	X(void, glDrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount)) \
+	X(void, glGenFramebuffers, (GLsizei n, GLuint* framebuffers)) \
+	X(void, glDeleteFramebuffers, (GLsizei n, const GLuint* framebuffers)) \
+	X(void, glBindFramebuffer, (GLenum target, GLuint framebuffer)) \
+	X(void, glFramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)) \
+	X(GLenum, glCheckFramebufferStatus, (GLenum target)) \
+	X(void, glGenQueries, (GLsizei n, GLuint* ids)) \
+	X(void, glBeginQuery, (GLenum target, GLuint id)) \
+	X(void, glEndQuery, (GLenum target)) \
+	X(void, glGetQueryObjectiv, (GLuint id, GLenum pname, GLint* params)) \
+	X(void, glGetQueryObjectui64v, (GLuint id, GLenum pname, unsigned long long* params))
+
+#define GL_DECLARE_FUNCTION(ret, name, params) \
+	typedef ret (GALAXY_APIENTRY* name##Proc) params; \
+	extern name##Proc galaxy_##name;
+GL_FUNCTION_LIST(GL_DECLARE_FUNCTION)
+#undef GL_DECLARE_FUNCTION
+
+// route the usual names to the loaded pointers
+#define glGenBuffers galaxy_glGenBuffers
+#define glDeleteBuffers galaxy_glDeleteBuffers
+#define glBindBuffer galaxy_glBindBuffer
+#define glBufferData galaxy_glBufferData
+#define glBufferSubData galaxy_glBufferSubData
+#define glGenVertexArrays galaxy_glGenVertexArrays
+#define glDeleteVertexArrays galaxy_glDeleteVertexArrays
+#define glBindVertexArray galaxy_glBindVertexArray
+#define glEnableVertexAttribArray galaxy_glEnableVertexAttribArray
+#define glDisableVertexAttribArray galaxy_glDisableVertexAttribArray
+#define glVertexAttribPointer galaxy_glVertexAttribPointer
+#define glVertexAttribIPointer galaxy_glVertexAttribIPointer
+#define glVertexAttrib1f galaxy_glVertexAttrib1f
+#define glCreateShader galaxy_glCreateShader
+#define glShaderSource galaxy_glShaderSource
+#define glCompileShader galaxy_glCompileShader
+#define glGetShaderiv galaxy_glGetShaderiv
+#define glGetShaderInfoLog galaxy_glGetShaderInfoLog
+#define glDeleteShader galaxy_glDeleteShader
+#define glCreateProgram galaxy_glCreateProgram
+#define glAttachShader galaxy_glAttachShader
+#define glBindAttribLocation galaxy_glBindAttribLocation
+#define glLinkProgram galaxy_glLinkProgram
+#define glGetProgramiv galaxy_glGetProgramiv
+#define glGetProgramInfoLog galaxy_glGetProgramInfoLog
+#define glDeleteProgram galaxy_glDeleteProgram
+#define glUseProgram galaxy_glUseProgram
+#define glGetUniformLocation galaxy_glGetUniformLocation
+#define glUniform1i galaxy_glUniform1i
+#define glUniform1ui galaxy_glUniform1ui
+#define glUniform1f galaxy_glUniform1f
+#define glUniform2f galaxy_glUniform2f
+#define glUniform1fv galaxy_glUniform1fv
+#define glUniform2fv galaxy_glUniform2fv
+#define glUniform4f galaxy_glUniform4f
+#define glUniformMatrix4fv galaxy_glUniformMatrix4fv
+#define glActiveTexture galaxy_glActiveTexture
+#define glMultiDrawArrays galaxy_glMultiDrawArrays
+#define glVertexAttribDivisor galaxy_glVertexAttribDivisor
+#define glDrawArraysInstanced galaxy_glDrawArraysInstanced
+#define glDrawElementsInstanced galaxy_glDrawElementsInstanced
+#define glGenFramebuffers galaxy_glGenFramebuffers
+#define glDeleteFramebuffers galaxy_glDeleteFramebuffers
+#define glBindFramebuffer galaxy_glBindFramebuffer
+#define glFramebufferTexture2D galaxy_glFramebufferTexture2D
+#define glCheckFramebufferStatus galaxy_glCheckFramebufferStatus
+#define glGenQueries galaxy_glGenQueries
+#define glBeginQuery galaxy_glBeginQuery
+#define glEndQuery galaxy_glEndQuery
+#define glGetQueryObjectiv galaxy_glGetQueryObjectiv
+#define glGetQueryObjectui64v galaxy_glGetQueryObjectui64v
+
+// true if every entry point above was found
+bool loadGLFunctions();
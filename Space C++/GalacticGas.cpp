@@ -1,8 +1,12 @@
 #include "GalacticGas.h"
 #include "SolarSystem.h"
-#include <GLFW/glfw3.h>
+#include "Renderer.h"
+#include "Camera.h"
 #include <iostream>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
 #include <random>
 
 #ifndef M_PI
@@ -13,6 +17,11 @@ struct Color4 {
     float r, g, b, a;
 };
 
+// bumped by generateGalacticGas so the renderer knows to rebuild its splats
+static unsigned int gasGeneration = 0;
+// simulation seconds since generation, the modern renderer orbits the clouds from it
+static double gasTime = 0.0;
+
 GasConfig createDefaultGasConfig() {
     GasConfig config;
 
@@ -125,7 +134,7 @@ void generateSpiralArmCloud(GasCloud& cloud, std::mt19937& rng, int numArms,
     cloud.z = radius * sin(spiralAngle) + armOffset * sin(perpAngle);
 
     cloud.orbitalRadius = sqrt(cloud.x * cloud.x + cloud.z * cloud.z);
-    cloud.angle = atan2(cloud.z, cloud.x);
+    cloud.phase = phaseFromRadians(atan2(cloud.z, cloud.x));
 }
 
 void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& config,
@@ -135,6 +144,8 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
     std::normal_distribution<float> normalDist(0.0f, 1.0f);
 
     gasClouds.clear();
+    gasGeneration++;
+    gasTime = 0.0;
 
     int totalClouds = config.numMolecularClouds + config.numColdNeutralClouds +
                       config.numWarmNeutralClouds + config.numWarmIonizedClouds +
@@ -165,7 +176,7 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
         // orbital motion (slower in spiral arms due to density wave)
         cloud.angularVelocity = 0.3f / (sqrt(cloud.orbitalRadius / bulgeRadius) * (cloud.orbitalRadius + 1.0f));
 
-        cloud.turbulencePhase = dist(rng) * 2.0f * M_PI;
+        cloud.turbulencePhase = phaseFromRadians(dist(rng) * 2.0f * M_PI);
         cloud.turbulenceSpeed = 0.1f + dist(rng) * 0.2f;
 
         bool isDark;
@@ -203,14 +214,14 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
         cloud.y = normalDist(rng) * config.neutralScaleHeight;
 
         cloud.orbitalRadius = radius;
-        cloud.angle = theta;
+        cloud.phase = phaseFromRadians(theta);
         cloud.angularVelocity = 0.4f / (sqrt(radius / bulgeRadius) * (radius + 1.0f));
 
         cloud.mass = 100.0f + dist(rng) * 1000.0f;
         cloud.smoothingLength = 8.0f + dist(rng) * 20.0f;
         cloud.density = 0.3f + dist(rng) * 0.4f;
 
-        cloud.turbulencePhase = dist(rng) * 2.0f * M_PI;
+        cloud.turbulencePhase = phaseFromRadians(dist(rng) * 2.0f * M_PI);
         cloud.turbulenceSpeed = 0.2f + dist(rng) * 0.3f;
 
         bool isDark;
@@ -248,14 +259,14 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
         cloud.y = normalDist(rng) * config.neutralScaleHeight * 1.5f;
 
         cloud.orbitalRadius = radius;
-        cloud.angle = theta;
+        cloud.phase = phaseFromRadians(theta);
         cloud.angularVelocity = 0.4f / (sqrt(radius / bulgeRadius) * (radius + 1.0f));
 
         cloud.mass = 50.0f + dist(rng) * 500.0f;
         cloud.smoothingLength = 10.0f + dist(rng) * 30.0f;
         cloud.density = 0.2f + dist(rng) * 0.3f;
 
-        cloud.turbulencePhase = dist(rng) * 2.0f * M_PI;
+        cloud.turbulencePhase = phaseFromRadians(dist(rng) * 2.0f * M_PI);
         cloud.turbulenceSpeed = 0.3f + dist(rng) * 0.4f;
 
         bool isDark;
@@ -289,7 +300,7 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
 
         cloud.angularVelocity = 0.35f / (sqrt(cloud.orbitalRadius / bulgeRadius) * (cloud.orbitalRadius + 1.0f));
 
-        cloud.turbulencePhase = dist(rng) * 2.0f * M_PI;
+        cloud.turbulencePhase = phaseFromRadians(dist(rng) * 2.0f * M_PI);
         cloud.turbulenceSpeed = 0.4f + dist(rng) * 0.5f;
 
         bool isDark;
@@ -327,14 +338,14 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
         cloud.y = normalDist(rng) * config.ionizedScaleHeight;
 
         cloud.orbitalRadius = radius;
-        cloud.angle = theta;
+        cloud.phase = phaseFromRadians(theta);
         cloud.angularVelocity = 0.4f / (sqrt(radius / bulgeRadius) * (radius + 1.0f));
 
         cloud.mass = 1.0f + dist(rng) * 50.0f;
         cloud.smoothingLength = 12.0f + dist(rng) * 40.0f;
         cloud.density = 0.15f + dist(rng) * 0.25f;
 
-        cloud.turbulencePhase = dist(rng) * 2.0f * M_PI;
+        cloud.turbulencePhase = phaseFromRadians(dist(rng) * 2.0f * M_PI);
         cloud.turbulenceSpeed = 0.6f + dist(rng) * 0.8f;
 
         bool isDark;
@@ -367,7 +378,7 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
         cloud.z = radius * cos(phi);
 
         cloud.orbitalRadius = sqrt(cloud.x * cloud.x + cloud.z * cloud.z);
-        cloud.angle = atan2(cloud.z, cloud.x);
+        cloud.phase = phaseFromRadians(atan2(cloud.z, cloud.x));
         cloud.angularVelocity = 0.1f / (cloud.orbitalRadius + 1.0f);
 
         // Very diffuse
@@ -375,7 +386,7 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
         cloud.smoothingLength = 40.0f + dist(rng) * 120.0f;
         cloud.density = 0.05f + dist(rng) * 0.1f;
 
-        cloud.turbulencePhase = dist(rng) * 2.0f * M_PI;
+        cloud.turbulencePhase = phaseFromRadians(dist(rng) * 2.0f * M_PI);
         cloud.turbulenceSpeed = 0.05f + dist(rng) * 0.1f;
 
         bool isDark;
@@ -394,206 +405,995 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
 }
 
 void updateGalacticGas(std::vector<GasCloud>& gasClouds, double deltaTime) {
-    const float TWO_PI = 2.0f * M_PI;
+    gasTime += deltaTime;
 
     for (auto& cloud : gasClouds) {
-        cloud.angle += cloud.angularVelocity * deltaTime;
+        cloud.phase += phaseStep(cloud.angularVelocity, deltaTime);
 
-        cloud.angle = fmodf(cloud.angle, TWO_PI);
-        if (cloud.angle < 0.0f) cloud.angle += TWO_PI;
+        float sinA, cosA;
+        phaseSinCos(cloud.phase, sinA, cosA);
 
         float oldY = cloud.y;
-        cloud.x = cloud.orbitalRadius * cos(cloud.angle);
-        cloud.z = cloud.orbitalRadius * sin(cloud.angle);
+        cloud.x = cloud.orbitalRadius * cosA;
+        cloud.z = cloud.orbitalRadius * sinA;
 
         if (cloud.type != GasType::CORONAL) {
             cloud.y = oldY;
         }
 
-        cloud.turbulencePhase += cloud.turbulenceSpeed * deltaTime;
-        cloud.turbulencePhase = fmodf(cloud.turbulencePhase, TWO_PI);
-        if (cloud.turbulencePhase < 0.0f) cloud.turbulencePhase += TWO_PI;
+        cloud.turbulencePhase += phaseStep(cloud.turbulenceSpeed, deltaTime);
     }
 }
 
-void renderGalacticGas(const std::vector<GasCloud>& gasClouds, const RenderZone& zone) {
-    glEnable(GL_BLEND);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_POINT_SMOOTH);
+// every cloud is drawn as a few round point sprites ("splats"), sizes are in pixels
+// fixed-function points take their size from glPointSize, so the legacy path draws
+// one batch per 5 pixel bin
+static const int MAX_SIZE_BINS = 40;
+static const float SIZE_BIN = 5.0f;
+static const float MAX_POINT_SIZE = (MAX_SIZE_BINS - 1) * SIZE_BIN;
+
+static int sizeBinOf(float size) {
+    int sizeBin = (int)(size / SIZE_BIN);
+    if (sizeBin < 0) sizeBin = 0;
+    if (sizeBin >= MAX_SIZE_BINS) sizeBin = MAX_SIZE_BINS - 1;
+    return sizeBin;
+}
+
+// dark lanes: concentric layers that multiply the background down
+static void darkLaneSplat(const GasCloud& cloud, int layer, int numLayers, float& darken, float& size) {
+    const float smoothingLength2x = cloud.smoothingLength * 2.0f;
+    float t = layer / (float)(numLayers - 1);
+    float r = t * smoothingLength2x;
+    float w = cubicSplineKernel2D(r, cloud.smoothingLength);
+
+    float extinction = cloud.alpha * 0.6f * w;
+    darken = 1.0f - extinction;
+    size = smoothingLength2x * (1.0f + t * 0.3f);
+}
+
+// emissive clouds: parallel filaments along rotationAngle, each a stack of layers
+static void emissiveFilament(const GasCloud& cloud, int filament, int numFilaments,
+                             float& offsetX, float& offsetZ, float& falloff) {
+    const float filamentOffset = (filament - numFilaments / 2) * cloud.smoothingLength * 0.4f;
+    offsetX = filamentOffset * cos(cloud.rotationAngle);
+    offsetZ = filamentOffset * sin(cloud.rotationAngle);
+    falloff = exp(-filament * filament * 0.8f);
+}
+
+static float emissiveBaseSize(const GasCloud& cloud) {
+    return cloud.smoothingLength * 1.2f * (1.0f + cloud.elongation * 0.5f);
+}
+
+static void emissiveSplat(const GasCloud& cloud, float falloff, int layer, int numLayers, float& alpha, float& size) {
+    float t = layer / (float)(numLayers - 1);
+    float gaussian = exp(-t * t * 2.5f);
+    alpha = cloud.alpha * 0.8f * gaussian * falloff;
+    size = emissiveBaseSize(cloud) * (1.0f + t * 0.2f);
+}
 
-    // LOD based on zoom
-    int numFilaments = 3;
-    int numLayersPerFilament = 4;
+// level of detail: fewer layers when zoomed out, every skipFactor-th cloud when zoomed in
+struct GasLod {
+    int darkLaneLayers;
+    int numFilaments;
+    int layersPerFilament;
+    int skipFactor;
+    bool drawDarkLanes;
+    bool drawCoronal;
+};
+
+static GasLod gasLod(const RenderZone& zone) {
+    GasLod lod;
+    lod.darkLaneLayers = (zone.zoomLevel < 2.0) ? 3 : 4;
+    lod.numFilaments = 3;
+    lod.layersPerFilament = 4;
     if (zone.zoomLevel < 0.5) {
-        numFilaments = 2;
-        numLayersPerFilament = 3;
+        lod.numFilaments = 2;
+        lod.layersPerFilament = 3;
     }
 
-    // culling at high zoom
-    int skipFactor = 1;
-    if (zone.zoomLevel > 100.0) skipFactor = 4;
-    else if (zone.zoomLevel > 50.0) skipFactor = 3;
-    else if (zone.zoomLevel > 20.0) skipFactor = 2;
+    lod.skipFactor = 1;
+    if (zone.zoomLevel > 100.0) lod.skipFactor = 4;
+    else if (zone.zoomLevel > 50.0) lod.skipFactor = 3;
+    else if (zone.zoomLevel > 20.0) lod.skipFactor = 2;
 
-    const int MAX_SIZE_BINS = 40;
-    const float SIZE_BIN = 5.0f;
+    // a still, paused view gets every cloud (see g_renderRefinement). the layer counts stay
+    // as they are, fewer or more layers change the gas's tint
+    if (g_renderRefinement >= 3) {
+        lod.skipFactor = 1;
+    }
 
-    static std::vector<float> verticesBySize[MAX_SIZE_BINS];
-    static std::vector<float> colorsBySize[MAX_SIZE_BINS];
+    lod.drawDarkLanes = zone.zoomLevel >= 0.1;
+    lod.drawCoronal = zone.zoomLevel >= 0.001;
+    return lod;
+}
 
-    static std::vector<int> darkLaneIndices;
-    static std::vector<int> emissiveIndices;
+// modern path: every cloud is one screen-aligned quad instead of a stack of points.
+// the layers only differ in weight and size, so a table of both per layer count is baked
+// once and the fragment shader adds the layers up itself, for every filament: an emissive
+// cloud costs one quad instead of up to 12 overlapping points and a dark lane one
+// instead of 3-4.
+// the quads go into a static buffer once per generation: the shader orbits each cloud
+// the same way it orbits the stars, and drops the ones the LOD skips by their flags.
+// the buffer is sorted into cells like the stars' polar index so only the cells in view
+// are drawn, and sorted again now and then as the clouds drift apart (see GasCell)
+static const double GAS_TICKS_PER_SECOND = 64.0;
+static const double GAS_MIN_REFERENCE_DISTANCE = 100.0;    // the neutral gas scale height
+
+// which of the every-2nd/3rd/4th subsets a cloud is in, and whether it's coronal
+static const uint8_t GAS_SPRITE_EVERY_2ND = 1;
+static const uint8_t GAS_SPRITE_EVERY_3RD = 2;
+static const uint8_t GAS_SPRITE_EVERY_4TH = 4;
+static const uint8_t GAS_SPRITE_CORONAL = 8;
+
+// one corner of a cloud's quad, the shader picks the corner from gl_VertexID
+struct GasSpriteVertex {
+    float radius;
+    OrbitalPhase phase;         // at the upload
+    OrbitalPhase phaseStep;     // per tick
+    float y;
+    float strength;             // alpha of the first layer, or its extinction for dark lanes
+    uint16_t angle;             // rotationAngle, half float
+    uint16_t spacing;           // world distance between filaments, half float
+    uint16_t size;              // first layer in pixels at the reference depth, half float
+    uint8_t r, g, b;
+    uint8_t flags;
+};
 
-    darkLaneIndices.clear();
-    emissiveIndices.clear();
-    darkLaneIndices.reserve(gasClouds.size() / 10);
-    emissiveIndices.reserve(gasClouds.size());
+// what darkLaneSplat / emissiveSplat give each layer, relative to the first one
+enum GasProfileKind {
+    GAS_PROFILE_DARK_3,
+    GAS_PROFILE_DARK_4,
+    GAS_PROFILE_EMISSIVE_3,
+    GAS_PROFILE_EMISSIVE_4,
+    NUM_GAS_PROFILES
+};
 
+struct GasProfile {
+    int numLayers;
+    float weights[4];
+    float sizes[4];
+};
+
+static GLuint gasProgram = 0;
+static GLint gasMvpLocation = -1;
+static GLint gasTickLocation = -1;
+static GLint gasTickFractionLocation = -1;
+static GLint gasRequireLocation = -1;
+static GLint gasRejectLocation = -1;
+static GLint gasReferenceDepthLocation = -1;
+static GLint gasMaxPointSizeLocation = -1;
+static GLint gasPixelScaleLocation = -1;
+static GLint gasViewportLocation = -1;
+static GLint gasFilamentsLocation = -1;
+static GLint gasLayersLocation = -1;
+static GLint gasLayerWeightsLocation = -1;
+static GLint gasLayerSizesLocation = -1;
+static GLint gasDarkenLocation = -1;
+static GLuint gasVao = 0;
+static GLuint gasVbo = 0;
+static GasProfile gasProfiles[NUM_GAS_PROFILES];
+static unsigned int gasBufferGeneration = 0;
+static double gasBufferTime = 0.0;
+static GLsizei gasDarkLaneVertices = 0;
+static GLsizei gasEmissiveVertices = 0;
+
+// a cell is the clouds of one radial band that were in one angle sector at the upload,
+// with the dark lanes, the disk gas and the far thicker coronal gas kept apart. the
+// clouds orbit at their own speeds, so a cell's arc widens by the spread of its angular
+// velocities as time goes on, and the buffer is sorted again once that has grown a few
+// sectors for half the gas
+static const int GAS_CELL_BANDS = 16;
+static const int GAS_CELL_SECTORS = 32;
+static const int GAS_CELLS_PER_GROUP = GAS_CELL_BANDS * GAS_CELL_SECTORS;
+static const double GAS_CELL_MAX_SPREAD = 4.0;  // in sectors
+
+enum GasCellGroup {
+    GAS_GROUP_DARK_LANES,
+    GAS_GROUP_DISK,
+    GAS_GROUP_CORONAL,
+    NUM_GAS_GROUPS
+};
+
+struct GasCell {
+    GLint first;
+    GLsizei count;              // in vertices, six a cloud
+    float minRadius, maxRadius;
+    float minY, maxY;
+    float minAngularVelocity, maxAngularVelocity;
+    float reach;                // furthest a filament sits from its cloud
+};
+
+static std::vector<GasCell> gasCells;
+static double gasBufferSortTime = 0.0;     // gasTime the cells are next sorted again at
+
+// two timer queries in turn, so the one read back is a frame old and never stalls
+static GLuint gasTimerQueries[2] = { 0, 0 };
+static unsigned int gasTimerFrame = 0;
+static double gasTimerMilliseconds = -1.0;
+
+static const char* GAS_VERTEX_SHADER = R"(#version 330 core
+in float aRadius;
+in uint aPhase;
+in uint aPhaseStep;
+in float aY;
+in float aStrength;
+in float aAngle;
+in float aSpacing;
+in float aSize;
+in vec3 aColor;
+in uint aFlags;
+
+uniform mat4 uMVP;
+uniform uint uTick;
+uniform float uTickFraction;
+uniform uint uRequire;
+uniform uint uReject;
+uniform vec4 uViewport;
+uniform float uReferenceDepth;
+uniform float uMaxPointSize;
+uniform float uPixelScale;
+uniform int uFilaments;
+uniform vec4 uLayerSizes;
+
+out vec2 vOffset;
+flat out vec2 vSeparation;
+flat out vec4 vLayerRadii;
+flat out vec3 vColor;
+flat out float vStrength;
+
+const float PHASE_TO_RADIANS = 6.283185307179586 / 4294967296.0;
+const vec2 CORNERS[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+	vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+	uint phase = aPhase + aPhaseStep * uTick + uint(int(float(int(aPhaseStep)) * uTickFraction));
+	float angle = float(int(phase)) * PHASE_TO_RADIANS;
+	vec3 position = vec3(aRadius * cos(angle), aY, aRadius * sin(angle));
+	vec4 center = uMVP * vec4(position, 1.0);
+
+	// skipped, or behind the eye: outside the clip volume, so the quad is dropped
+	if ((aFlags & uRequire) != uRequire || (aFlags & uReject) != 0u || center.w <= 0.0) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	// pixels from one filament to the next
+	vec4 next = uMVP * vec4(position + vec3(cos(aAngle), 0.0, sin(aAngle)) * aSpacing, 1.0);
+	vec2 separation = next.w > 0.0 ? (next.xy / next.w - center.xy / center.w) * 0.5 * uViewport.zw : vec2(0.0);
+
+	// sizes are right at the reference depth, nearer clouds grow and further ones shrink.
+	// each layer clamps on its own like the points did, so far out they all end up as wide.
+	// sizes are in window pixels, uPixelScale takes them to the target's
+	float depthScale = clamp(uReferenceDepth / center.w, 0.25, 4.0);
+	vec4 layerRadii = 0.5 * clamp(aSize * uLayerSizes * depthScale, 1.0, uMaxPointSize) * uPixelScale;
+	float radius = max(max(layerRadii.x, layerRadii.y), max(layerRadii.z, layerRadii.w));
+
+	// filament k sits at k * separation, k from -(n / 2) to n - 1 - n / 2
+	float gap = length(separation);
+	vec2 along = gap > 0.001 ? separation / gap : vec2(1.0, 0.0);
+	vec2 across = vec2(-along.y, along.x);
+	vec2 corner = CORNERS[gl_VertexID % 6];
+	float k = corner.x < 0.0 ? -float(uFilaments / 2) : float(uFilaments - 1 - uFilaments / 2);
+	vec2 offset = along * (k * gap + corner.x * (radius + 1.0)) + across * corner.y * (radius + 1.0);
+
+	vOffset = offset;
+	vSeparation = separation;
+	vLayerRadii = layerRadii;
+	vColor = aColor;
+	vStrength = aStrength;
+	gl_Position = center + vec4(offset * 2.0 / uViewport.zw * center.w, 0.0, 0.0);
+}
+)";
+
+// every layer of every filament is the antialiased disc the points were. each one is
+// rounded to 8 bits on its own, as blending it into the framebuffer did: most of the
+// faint clouds' layers are under one step, and that rounding is a good part of their look
+static const char* GAS_FRAGMENT_SHADER = R"(#version 330 core
+in vec2 vOffset;
+flat in vec2 vSeparation;
+flat in vec4 vLayerRadii;
+flat in vec3 vColor;
+flat in float vStrength;
+
+uniform int uFilaments;
+uniform int uLayers;
+uniform vec4 uLayerWeights;
+uniform bool uDarken;
+
+out vec4 fragColor;
+
+void main() {
+	// dark lanes multiply the background by the darkening of every layer over it
+	if (uDarken) {
+		float transmitted = 1.0;
+		for (int i = 0; i < uLayers; i++) {
+			if (length(vOffset) < vLayerRadii[i] + 0.5) {
+				transmitted *= floor((1.0 - vStrength * uLayerWeights[i]) * 255.0 + 0.5) / 255.0;
+			}
+		}
+		if (transmitted >= 1.0) discard;
+		fragColor = vec4(vec3(transmitted), 1.0);
+		return;
+	}
+
+	vec3 total = vec3(0.0);
+	for (int f = 0; f < uFilaments; f++) {
+		float falloff = exp(-float(f * f) * 0.8);
+		float r = length(vOffset - float(f - uFilaments / 2) * vSeparation);
+		for (int i = 0; i < uLayers; i++) {
+			float coverage = clamp(vLayerRadii[i] - r + 0.5, 0.0, 1.0);
+			float alpha = vStrength * uLayerWeights[i] * falloff * coverage;
+			total += floor(vColor * alpha * 255.0 + 0.5) / 255.0;
+		}
+	}
+	if (total == vec3(0.0)) discard;
+	fragColor = vec4(total, 1.0);
+}
+)";
+
+// the layer tables: darkLaneSplat and emissiveSplat over the first layer
+static void bakeGasProfiles() {
+    for (int kind = 0; kind < NUM_GAS_PROFILES; kind++) {
+        GasProfile& profile = gasProfiles[kind];
+        bool darkLane = kind == GAS_PROFILE_DARK_3 || kind == GAS_PROFILE_DARK_4;
+        profile.numLayers = (kind == GAS_PROFILE_DARK_3 || kind == GAS_PROFILE_EMISSIVE_3) ? 3 : 4;
+
+        for (int i = 0; i < 4; i++) {
+            profile.weights[i] = 0.0f;
+            profile.sizes[i] = 0.0f;
+            if (i >= profile.numLayers) continue;
+
+            float t = i / (float)(profile.numLayers - 1);
+            if (darkLane) {
+                profile.weights[i] = cubicSplineKernel2D(t * 2.0f, 1.0f) / cubicSplineKernel2D(0.0f, 1.0f);
+                profile.sizes[i] = 1.0f + t * 0.3f;
+            } else {
+                profile.weights[i] = exp(-t * t * 2.5f);
+                profile.sizes[i] = 1.0f + t * 0.2f;
+            }
+        }
+    }
+}
+
+static bool initGasProgram() {
+    gasProgram = createShaderProgram("gas", GAS_VERTEX_SHADER, GAS_FRAGMENT_SHADER,
+        { "aRadius", "aPhase", "aPhaseStep", "aY", "aStrength", "aAngle", "aSpacing", "aSize", "aColor", "aFlags" });
+    if (!gasProgram) return false;
+
+    gasMvpLocation = glGetUniformLocation(gasProgram, "uMVP");
+    gasTickLocation = glGetUniformLocation(gasProgram, "uTick");
+    gasTickFractionLocation = glGetUniformLocation(gasProgram, "uTickFraction");
+    gasRequireLocation = glGetUniformLocation(gasProgram, "uRequire");
+    gasRejectLocation = glGetUniformLocation(gasProgram, "uReject");
+    gasReferenceDepthLocation = glGetUniformLocation(gasProgram, "uReferenceDepth");
+    gasMaxPointSizeLocation = glGetUniformLocation(gasProgram, "uMaxPointSize");
+    gasPixelScaleLocation = glGetUniformLocation(gasProgram, "uPixelScale");
+    gasViewportLocation = glGetUniformLocation(gasProgram, "uViewport");
+    gasFilamentsLocation = glGetUniformLocation(gasProgram, "uFilaments");
+    gasLayersLocation = glGetUniformLocation(gasProgram, "uLayers");
+    gasLayerWeightsLocation = glGetUniformLocation(gasProgram, "uLayerWeights");
+    gasLayerSizesLocation = glGetUniformLocation(gasProgram, "uLayerSizes");
+    gasDarkenLocation = glGetUniformLocation(gasProgram, "uDarken");
+
+    bakeGasProfiles();
+
+    glGenVertexArrays(1, &gasVao);
+    glGenBuffers(1, &gasVbo);
+
+    glBindVertexArray(gasVao);
+    glBindBuffer(GL_ARRAY_BUFFER, gasVbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, radius));
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, phase));
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, phaseStep));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, y));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, strength));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, angle));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, spacing));
+    glEnableVertexAttribArray(7);
+    glVertexAttribPointer(7, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, size));
+    glEnableVertexAttribArray(8);
+    glVertexAttribPointer(8, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, r));
+    glEnableVertexAttribArray(9);
+    glVertexAttribIPointer(9, 1, GL_UNSIGNED_BYTE, sizeof(GasSpriteVertex), (const void*)offsetof(GasSpriteVertex, flags));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenQueries(2, gasTimerQueries);
+    return true;
+}
+
+static uint8_t unitToByte(float value) {
+    if (value <= 0.0f) return 0;
+    if (value >= 1.0f) return 255;
+    return (uint8_t)(value * 255.0f + 0.5f);
+}
+
+static GasCellGroup gasCellGroup(const GasCloud& cloud) {
+    if (cloud.isDarkLane) return GAS_GROUP_DARK_LANES;
+    return cloud.type == GasType::CORONAL ? GAS_GROUP_CORONAL : GAS_GROUP_DISK;
+}
+
+// group * GAS_CELLS_PER_GROUP + band * GAS_CELL_SECTORS + sector for every cloud, the
+// bands at the radii that split their group into equal counts
+static void assignGasCells(const std::vector<GasCloud>& gasClouds, std::vector<uint32_t>& cellIds) {
+    std::vector<float> radii[NUM_GAS_GROUPS];
+    for (const auto& cloud : gasClouds) {
+        radii[gasCellGroup(cloud)].push_back(cloud.orbitalRadius);
+    }
+
+    float bandEdges[NUM_GAS_GROUPS][GAS_CELL_BANDS - 1] = {};
+    for (int group = 0; group < NUM_GAS_GROUPS; group++) {
+        std::vector<float>& groupRadii = radii[group];
+        if (groupRadii.empty()) continue;
+
+        auto searchFrom = groupRadii.begin();
+        for (int edge = 0; edge < GAS_CELL_BANDS - 1; edge++) {
+            auto nth = groupRadii.begin() + groupRadii.size() * (edge + 1) / GAS_CELL_BANDS;
+            std::nth_element(searchFrom, nth, groupRadii.end());
+            bandEdges[group][edge] = *nth;
+            searchFrom = nth;
+        }
+    }
+
+    cellIds.resize(gasClouds.size());
     for (size_t i = 0; i < gasClouds.size(); i++) {
-        if (gasClouds[i].isDarkLane) {
-            darkLaneIndices.push_back(i);
+        const GasCloud& cloud = gasClouds[i];
+        int group = gasCellGroup(cloud);
+        const float* edges = bandEdges[group];
+        int band = (int)(std::upper_bound(edges, edges + GAS_CELL_BANDS - 1, cloud.orbitalRadius) - edges);
+        int sector = (int)(((uint64_t)cloud.phase * GAS_CELL_SECTORS) >> 32);
+        cellIds[i] = group * GAS_CELLS_PER_GROUP + band * GAS_CELL_SECTORS + sector;
+    }
+}
+
+static void uploadGasBuffer(const std::vector<GasCloud>& gasClouds) {
+    // the LOD subsets go by each cloud's place in its list, before the sort
+    std::vector<uint8_t> flags(gasClouds.size());
+    size_t listIndex[2] = { 0, 0 };
+    for (size_t i = 0; i < gasClouds.size(); i++) {
+        const GasCloud& cloud = gasClouds[i];
+        size_t index = listIndex[cloud.isDarkLane ? 0 : 1]++;
+
+        flags[i] = 0;
+        if (index % 2 == 0) flags[i] |= GAS_SPRITE_EVERY_2ND;
+        if (index % 3 == 0) flags[i] |= GAS_SPRITE_EVERY_3RD;
+        if (index % 4 == 0) flags[i] |= GAS_SPRITE_EVERY_4TH;
+        if (cloud.type == GasType::CORONAL) flags[i] |= GAS_SPRITE_CORONAL;
+    }
+
+    // counting sort by cell, stable so each cell keeps the clouds' order
+    std::vector<uint32_t> cellIds;
+    assignGasCells(gasClouds, cellIds);
+    const size_t numCells = NUM_GAS_GROUPS * GAS_CELLS_PER_GROUP;
+    std::vector<size_t> next(numCells + 1, 0);
+    for (uint32_t cell : cellIds) {
+        next[cell + 1]++;
+    }
+    for (size_t cell = 1; cell <= numCells; cell++) {
+        next[cell] += next[cell - 1];
+    }
+    std::vector<size_t> order(gasClouds.size());
+    for (size_t i = 0; i < gasClouds.size(); i++) {
+        order[next[cellIds[i]]++] = i;
+    }
+
+    // the groups come out in order: dark lanes first, then the emissive clouds, six corners each
+    std::vector<GasSpriteVertex> vertices;
+    vertices.reserve(gasClouds.size() * 6);
+    gasCells.assign(numCells, GasCell{ 0, 0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    gasDarkLaneVertices = 0;
+    for (size_t i : order) {
+        const auto& cloud = gasClouds[i];
+        bool darkLanes = cloud.isDarkLane;
+
+        GasSpriteVertex v;
+        v.radius = cloud.orbitalRadius;
+        v.phase = cloud.phase;
+        v.phaseStep = phaseStep(cloud.angularVelocity, 1.0 / GAS_TICKS_PER_SECOND);
+        v.y = cloud.y;
+        v.angle = floatToHalf(cloud.rotationAngle);
+        v.spacing = floatToHalf(cloud.smoothingLength * 0.4f);
+        if (darkLanes) {
+            v.strength = cloud.alpha * 0.6f * cubicSplineKernel2D(0.0f, cloud.smoothingLength);
+            v.size = floatToHalf(cloud.smoothingLength * 2.0f);
         } else {
-            emissiveIndices.push_back(i);
+            v.strength = cloud.alpha * 0.8f;
+            v.size = floatToHalf(emissiveBaseSize(cloud));
         }
+        v.r = unitToByte(cloud.r);
+        v.g = unitToByte(cloud.g);
+        v.b = unitToByte(cloud.b);
+        v.flags = flags[i];
+
+        GasCell& cell = gasCells[cellIds[i]];
+        if (cell.count == 0) {
+            cell.first = (GLint)vertices.size();
+            cell.minRadius = cell.maxRadius = cloud.orbitalRadius;
+            cell.minY = cell.maxY = cloud.y;
+            cell.minAngularVelocity = cell.maxAngularVelocity = cloud.angularVelocity;
+        } else {
+            cell.minRadius = std::min(cell.minRadius, cloud.orbitalRadius);
+            cell.maxRadius = std::max(cell.maxRadius, cloud.orbitalRadius);
+            cell.minY = std::min(cell.minY, cloud.y);
+            cell.maxY = std::max(cell.maxY, cloud.y);
+            cell.minAngularVelocity = std::min(cell.minAngularVelocity, cloud.angularVelocity);
+            cell.maxAngularVelocity = std::max(cell.maxAngularVelocity, cloud.angularVelocity);
+        }
+        // the outer filaments sit one spacing either side of the cloud
+        if (!darkLanes) cell.reach = std::max(cell.reach, cloud.smoothingLength * 0.4f);
+        cell.count += 6;
+
+        vertices.insert(vertices.end(), 6, v);
+        if (darkLanes) gasDarkLaneVertices = (GLsizei)vertices.size();
     }
+    gasEmissiveVertices = (GLsizei)vertices.size() - gasDarkLaneVertices;
+
+    glBindBuffer(GL_ARRAY_BUFFER, gasVbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GasSpriteVertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    gasBufferGeneration = gasGeneration;
+    gasBufferTime = gasTime;
+
+    // when half the clouds are in cells whose arcs have widened by GAS_CELL_MAX_SPREAD sectors
+    const double sectorAngle = 2.0 * M_PI / GAS_CELL_SECTORS;
+    std::vector<std::pair<double, GLsizei>> widenTimes;
+    for (const GasCell& cell : gasCells) {
+        if (cell.count == 0) continue;
+        double spread = cell.maxAngularVelocity - cell.minAngularVelocity;
+        widenTimes.push_back({ spread > 0.0 ? GAS_CELL_MAX_SPREAD * sectorAngle / spread : HUGE_VAL, cell.count });
+    }
+    std::sort(widenTimes.begin(), widenTimes.end());
+    gasBufferSortTime = HUGE_VAL;
+    size_t counted = 0;
+    for (const auto& widenTime : widenTimes) {
+        counted += widenTime.second;
+        if (counted * 2 >= vertices.size()) {
+            gasBufferSortTime = gasTime + widenTime.first;
+            break;
+        }
+    }
+}
 
-    for (int i = 0; i < MAX_SIZE_BINS; i++) {
-        verticesBySize[i].clear();
-        colorsBySize[i].clear();
+// frustum query on the cells, each one tested through the sphere around its arc as it
+// has widened by now. the frustum is widened by the largest quad, like pointVisible.
+// the shader places the first filament by mirroring the last one on screen, which for a
+// cloud right next to the eye can land in view when no filament is; like the legacy
+// path's per-filament test, only where the filaments really are counts
+static void findVisibleGasCells(int firstGroup, int endGroup, std::vector<GLint>& firsts, std::vector<GLsizei>& counts) {
+    const CameraView& view = g_cameraView;
+    double viewProjection[16];
+    double marginX = 1.0 / (1.0 + (MAX_POINT_SIZE + 2.0) / view.width);
+    double marginY = 1.0 / (1.0 + (MAX_POINT_SIZE + 2.0) / view.height);
+    for (int col = 0; col < 4; col++) {
+        viewProjection[col * 4 + 0] = view.viewProjection[col * 4 + 0] * marginX;
+        viewProjection[col * 4 + 1] = view.viewProjection[col * 4 + 1] * marginY;
+        viewProjection[col * 4 + 2] = view.viewProjection[col * 4 + 2];
+        viewProjection[col * 4 + 3] = view.viewProjection[col * 4 + 3];
     }
+    Frustum frustum;
+    frustum.extract(viewProjection);
+
+    const double sectorAngle = 2.0 * M_PI / GAS_CELL_SECTORS;
+    const double elapsed = gasTime - gasBufferTime;
+
+    firsts.clear();
+    counts.clear();
+    for (size_t i = firstGroup * GAS_CELLS_PER_GROUP; i < (size_t)endGroup * GAS_CELLS_PER_GROUP; i++) {
+        const GasCell& cell = gasCells[i];
+        if (cell.count == 0) continue;
+
+        double halfHeight = (cell.maxY - cell.minY) * 0.5;
+        double centerY = cell.minY + halfHeight;
+        double arc = sectorAngle + (cell.maxAngularVelocity - cell.minAngularVelocity) * elapsed;
+        double x = 0.0, z = 0.0, reach = cell.maxRadius;
+        if (arc < M_PI) {
+            // the far corners of the annular sector, as in the stars' findVisibleCells
+            double middle = (cell.minRadius + cell.maxRadius) * 0.5;
+            double halfArcCos = cos(arc * 0.5);
+            double inner = sqrt(std::max(0.0, cell.minRadius * cell.minRadius + middle * middle - 2.0 * cell.minRadius * middle * halfArcCos));
+            double outer = sqrt(std::max(0.0, cell.maxRadius * cell.maxRadius + middle * middle - 2.0 * cell.maxRadius * middle * halfArcCos));
+            double angle = (i % GAS_CELL_SECTORS) * sectorAngle + cell.minAngularVelocity * elapsed + arc * 0.5;
+            x = middle * cos(angle);
+            z = middle * sin(angle);
+            reach = std::max(inner, outer);
+        }
+        double radius = sqrt(reach * reach + halfHeight * halfHeight) + cell.reach;
+        if (!frustum.sphereVisible(x, centerY, z, radius)) continue;
 
-    int estimatedVerticesPerBin = (gasClouds.size() / MAX_SIZE_BINS) * 4 * 3;
-    int estimatedColorsPerBin = (gasClouds.size() / MAX_SIZE_BINS) * 4 * 4;
-    for (int i = 0; i < MAX_SIZE_BINS; i++) {
-        verticesBySize[i].reserve(estimatedVerticesPerBin);
-        colorsBySize[i].reserve(estimatedColorsPerBin);
+        // whole cells next to each other go out as one range
+        if (!firsts.empty() && firsts.back() + counts.back() == cell.first) {
+            counts.back() += cell.count;
+            continue;
+        }
+        firsts.push_back(cell.first);
+        counts.push_back(cell.count);
     }
+}
 
-    glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+// below full resolution the dark lanes and the emissive gas each go into a target of
+// their own: the dark lanes as the fraction of the background they leave, the emissive
+// gas as what it adds. both are then upsampled over the stars
+float g_gasResolutionScale = 0.5f;
 
-    if (zone.zoomLevel >= 0.1) {
-        int numLayers = (zone.zoomLevel < 2.0) ? 3 : 4;
+struct GasTarget {
+    GLuint framebuffer;
+    GLuint texture;
+};
 
-        for (size_t idx = 0; idx < darkLaneIndices.size(); idx++) {
-            if (skipFactor > 1 && (idx % skipFactor) != 0) continue;
+static GasTarget gasDarkLaneTarget = { 0, 0 };
+static GasTarget gasEmissiveTarget = { 0, 0 };
+static int gasTargetWidth = 0;
+static int gasTargetHeight = 0;
+
+static GLuint gasCompositeProgram = 0;
+static GLint gasCompositeSourceSizeLocation = -1;
+static GLint gasCompositeViewportLocation = -1;
+static GLuint gasCompositeVao = 0;
+
+// one triangle over the whole viewport, no attributes
+static const char* GAS_COMPOSITE_VERTEX_SHADER = R"(#version 330 core
+void main() {
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// bilinear, except that texels differing from the nearest one count for less, so the
+// hard edges of the layers stay hard instead of smearing over a low resolution texel
+static const char* GAS_COMPOSITE_FRAGMENT_SHADER = R"(#version 330 core
+uniform sampler2D uGas;
+uniform vec2 uSourceSize;
+uniform vec4 uViewport;
+
+out vec4 fragColor;
+
+const float EDGE_SHARPNESS = 100.0;
+
+void main() {
+	vec2 source = (gl_FragCoord.xy - uViewport.xy) / uViewport.zw * uSourceSize;
+	ivec2 last = ivec2(uSourceSize) - 1;
+	vec3 nearest = texelFetch(uGas, clamp(ivec2(source), ivec2(0), last), 0).rgb;
+
+	vec2 p = source - 0.5;
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - floor(p);
+
+	vec3 total = vec3(0.0);
+	float weights = 0.0;
+	for (int i = 0; i < 4; i++) {
+		ivec2 corner = ivec2(i & 1, i >> 1);
+		vec3 texel = texelFetch(uGas, clamp(base + corner, ivec2(0), last), 0).rgb;
+		vec2 bilinear = mix(1.0 - f, f, vec2(corner));
+		vec3 difference = texel - nearest;
+		float weight = bilinear.x * bilinear.y * exp(-dot(difference, difference) * EDGE_SHARPNESS);
+		total += texel * weight;
+		weights += weight;
+	}
+	fragColor = vec4(total / weights, 1.0);
+}
+)";
+
+// false if it doesn't compile, the gas then goes straight into the window
+static bool initGasComposite() {
+    gasCompositeProgram = createShaderProgram("gas composite", GAS_COMPOSITE_VERTEX_SHADER,
+        GAS_COMPOSITE_FRAGMENT_SHADER, {});
+    if (!gasCompositeProgram) {
+        std::cout << "Gas composite shader unavailable, drawing the gas at full resolution" << std::endl;
+        g_gasResolutionScale = 1.0f;
+        return false;
+    }
 
-            const auto& cloud = gasClouds[darkLaneIndices[idx]];
+    gasCompositeSourceSizeLocation = glGetUniformLocation(gasCompositeProgram, "uSourceSize");
+    gasCompositeViewportLocation = glGetUniformLocation(gasCompositeProgram, "uViewport");
+    glUseProgram(gasCompositeProgram);
+    glUniform1i(glGetUniformLocation(gasCompositeProgram, "uGas"), 0);
+    glUseProgram(0);
 
-            const float smoothingLength2x = cloud.smoothingLength * 2.0f;
-            const float alphaW06 = cloud.alpha * 0.6f;
+    // core profiles draw nothing without a vertex array bound, even an empty one
+    glGenVertexArrays(1, &gasCompositeVao);
+    return true;
+}
 
-            for (int i = 0; i < numLayers; i++) {
-                float t = i / (float)(numLayers - 1);
-                float r = t * smoothingLength2x;
-                float w = cubicSplineKernel2D(r, cloud.smoothingLength);
+static bool resizeGasTarget(GasTarget& target, int width, int height) {
+    if (!target.framebuffer) {
+        glGenFramebuffers(1, &target.framebuffer);
+        glGenTextures(1, &target.texture);
+    }
 
-                float extinction = alphaW06 * w;
-                float darken = 1.0f - extinction;
-                float size = smoothingLength2x * (1.0f + t * 0.3f);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint framebuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    return complete;
+}
 
-                int sizeBin = (int)(size / SIZE_BIN);
-                if (sizeBin < 0) sizeBin = 0;
-                if (sizeBin >= MAX_SIZE_BINS) sizeBin = MAX_SIZE_BINS - 1;
+// false if the targets can't be made, the same as above
+static bool resizeGasTargets(int width, int height) {
+    if (width == gasTargetWidth && height == gasTargetHeight) return true;
 
-                verticesBySize[sizeBin].push_back(cloud.x);
-                verticesBySize[sizeBin].push_back(cloud.y);
-                verticesBySize[sizeBin].push_back(cloud.z);
+    if (!resizeGasTarget(gasDarkLaneTarget, width, height) ||
+        !resizeGasTarget(gasEmissiveTarget, width, height)) {
+        std::cout << "Gas render targets unavailable, drawing the gas at full resolution" << std::endl;
+        g_gasResolutionScale = 1.0f;
+        return false;
+    }
 
-                colorsBySize[sizeBin].push_back(darken);
-                colorsBySize[sizeBin].push_back(darken);
-                colorsBySize[sizeBin].push_back(darken);
-                colorsBySize[sizeBin].push_back(1.0f);
-            }
-        }
+    gasTargetWidth = width;
+    gasTargetHeight = height;
+    return true;
+}
 
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glEnableClientState(GL_COLOR_ARRAY);
+static void beginGasTarget(const GasTarget& target, float clearValue) {
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glViewport(0, 0, gasTargetWidth, gasTargetHeight);
+    glClearColor(clearValue, clearValue, clearValue, clearValue);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
 
-        for (int sizeBin = 0; sizeBin < MAX_SIZE_BINS; sizeBin++) {
-            auto& vertices = verticesBySize[sizeBin];
-            auto& colors = colorsBySize[sizeBin];
+static void compositeGasTarget(const GasTarget& target) {
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+double gasPassMilliseconds() {
+    return gasTimerMilliseconds;
+}
 
-            if (vertices.empty()) continue;
+static void renderGalacticGasModern(const std::vector<GasCloud>& gasClouds, const GasLod& lod) {
+    if (gasBufferGeneration != gasGeneration || gasTime >= gasBufferSortTime) {
+        uploadGasBuffer(gasClouds);
+    }
 
-            glPointSize(sizeBin * SIZE_BIN);
-            glVertexPointer(3, GL_FLOAT, 0, vertices.data());
-            glColorPointer(4, GL_FLOAT, 0, colors.data());
-            glDrawArrays(GL_POINTS, 0, vertices.size() / 3);
+    GLuint timerQuery = gasTimerQueries[gasTimerFrame++ & 1];
+    if (gasTimerFrame > 2) {
+        GLint available = 0;
+        glGetQueryObjectiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            unsigned long long nanoseconds = 0;
+            glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &nanoseconds);
+            gasTimerMilliseconds = nanoseconds * 1e-6;
         }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+
+    // the buffer holds each phase as of its upload
+    double elapsed = (gasTime - gasBufferTime) * GAS_TICKS_PER_SECOND;
+    double ticks = floor(elapsed);
+    float tickFraction = (float)(elapsed - ticks);
+
+    GLuint require = 0;
+    if (lod.skipFactor == 2) require = GAS_SPRITE_EVERY_2ND;
+    else if (lod.skipFactor == 3) require = GAS_SPRITE_EVERY_3RD;
+    else if (lod.skipFactor == 4) require = GAS_SPRITE_EVERY_4TH;
+    GLuint reject = lod.drawCoronal ? 0 : GAS_SPRITE_CORONAL;
+
+    float mvp[16];
+    for (int i = 0; i < 16; i++) mvp[i] = (float)g_cameraView.viewProjection[i];
+
+    // the frame may itself be offscreen (the galaxy impostor)
+    GLint viewport[4], framebuffer;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+    int targetWidth = std::max(1, (int)(viewport[2] * g_gasResolutionScale + 0.5f));
+    int targetHeight = std::max(1, (int)(viewport[3] * g_gasResolutionScale + 0.5f));
+    bool offscreen = g_gasResolutionScale < 1.0f && (gasCompositeProgram || initGasComposite()) &&
+                     resizeGasTargets(targetWidth, targetHeight);
+
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+    // sizes hold at the depth of the galactic centre. close in, most of the gas in view
+    // is a disk thickness away whatever the centre does, so that's the least it goes
+    // down to (clip w is in zoomed units)
+    const double* view = g_cameraView.relativeView;
+    double zoom = sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+    float referenceDepth = (float)std::max(g_cameraView.viewProjection[15], zoom * GAS_MIN_REFERENCE_DISTANCE);
+
+    glUseProgram(gasProgram);
+    glUniformMatrix4fv(gasMvpLocation, 1, GL_FALSE, mvp);
+    glUniform1ui(gasTickLocation, (GLuint)(uint64_t)ticks);
+    glUniform1f(gasTickFractionLocation, tickFraction);
+    glUniform1ui(gasRequireLocation, require);
+    if (offscreen) {
+        glUniform4f(gasViewportLocation, 0.0f, 0.0f, (float)targetWidth, (float)targetHeight);
+        glUniform1f(gasPixelScaleLocation, (float)targetWidth / viewport[2]);
+    } else {
+        glUniform4f(gasViewportLocation, (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+        glUniform1f(gasPixelScaleLocation, 1.0f);
+    }
+    glUniform1f(gasReferenceDepthLocation, referenceDepth);
+    glUniform1f(gasMaxPointSizeLocation, MAX_POINT_SIZE);
+
+    glBindVertexArray(gasVao);
+
+    auto useProfile = [&](GasProfileKind kind) {
+        const GasProfile& profile = gasProfiles[kind];
+        glUniform1i(gasLayersLocation, profile.numLayers);
+        glUniform4f(gasLayerWeightsLocation, profile.weights[0], profile.weights[1], profile.weights[2], profile.weights[3]);
+        glUniform4f(gasLayerSizesLocation, profile.sizes[0], profile.sizes[1], profile.sizes[2], profile.sizes[3]);
+    };
+
+    static std::vector<GLint> firsts;
+    static std::vector<GLsizei> counts;
+
+    // dark lanes are never coronal
+    bool drawDarkLanes = lod.drawDarkLanes && gasDarkLaneVertices > 0;
+    if (drawDarkLanes) {
+        if (offscreen) beginGasTarget(gasDarkLaneTarget, 1.0f);
+        glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+        glUniform1ui(gasRejectLocation, 0);
+        glUniform1i(gasFilamentsLocation, 1);
+        glUniform1i(gasDarkenLocation, 1);
+        useProfile(lod.darkLaneLayers == 3 ? GAS_PROFILE_DARK_3 : GAS_PROFILE_DARK_4);
+        findVisibleGasCells(GAS_GROUP_DARK_LANES, GAS_GROUP_DISK, firsts, counts);
+        if (!firsts.empty()) glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), (GLsizei)firsts.size());
+    }
 
-        glDisableClientState(GL_VERTEX_ARRAY);
-        glDisableClientState(GL_COLOR_ARRAY);
+    // the layers come out already weighted, only the sum is left for the blend
+    if (gasEmissiveVertices > 0) {
+        if (offscreen) beginGasTarget(gasEmissiveTarget, 0.0f);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glUniform1ui(gasRejectLocation, reject);
+        glUniform1i(gasFilamentsLocation, lod.numFilaments);
+        glUniform1i(gasDarkenLocation, 0);
+        useProfile(lod.layersPerFilament == 3 ? GAS_PROFILE_EMISSIVE_3 : GAS_PROFILE_EMISSIVE_4);
+        findVisibleGasCells(GAS_GROUP_DISK, NUM_GAS_GROUPS, firsts, counts);
+        if (!firsts.empty()) glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), (GLsizei)firsts.size());
     }
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    // the same blends again, over the stars this time
+    if (offscreen) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+        glUseProgram(gasCompositeProgram);
+        glUniform2f(gasCompositeSourceSizeLocation, (float)targetWidth, (float)targetHeight);
+        glUniform4f(gasCompositeViewportLocation, (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+        glBindVertexArray(gasCompositeVao);
+        glActiveTexture(GL_TEXTURE0);
+
+        if (drawDarkLanes) {
+            glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+            compositeGasTarget(gasDarkLaneTarget);
+        }
+        if (gasEmissiveVertices > 0) {
+            glBlendFunc(GL_ONE, GL_ONE);
+            compositeGasTarget(gasEmissiveTarget);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+static void renderGalacticGasLegacy(const std::vector<GasCloud>& gasClouds, const GasLod& lod) {
+    // one batch per point size, each goes out in a single draw
+    static VertexBatch pointsBySize[MAX_SIZE_BINS];
+
+    static std::vector<int> darkLaneIndices;
+    static std::vector<int> emissiveIndices;
+
+    darkLaneIndices.clear();
+    emissiveIndices.clear();
+    darkLaneIndices.reserve(gasClouds.size() / 10);
+    emissiveIndices.reserve(gasClouds.size());
+
+    for (size_t i = 0; i < gasClouds.size(); i++) {
+        if (gasClouds[i].isDarkLane) {
+            darkLaneIndices.push_back(i);
+        } else {
+            emissiveIndices.push_back(i);
+        }
+    }
 
+    int estimatedVerticesPerBin = (gasClouds.size() / MAX_SIZE_BINS) * 4;
     for (int i = 0; i < MAX_SIZE_BINS; i++) {
-        verticesBySize[i].clear();
-        colorsBySize[i].clear();
+        pointsBySize[i].clear();
+        pointsBySize[i].begin(GL_POINTS);
+        pointsBySize[i].vertices.reserve(estimatedVerticesPerBin);
     }
 
-    for (size_t idx = 0; idx < emissiveIndices.size(); idx++) {
-        if (skipFactor > 1 && (idx % skipFactor) != 0) continue;
+    auto drawSizeBins = [&]() {
+        for (int sizeBin = 0; sizeBin < MAX_SIZE_BINS; sizeBin++) {
+            if (pointsBySize[sizeBin].vertices.empty()) continue;
 
-        const auto& cloud = gasClouds[emissiveIndices[idx]];
+            glPointSize(sizeBin * SIZE_BIN);
+            pointsBySize[sizeBin].draw();
+        }
+    };
+
+    glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+
+    if (lod.drawDarkLanes) {
+        for (size_t idx = 0; idx < darkLaneIndices.size(); idx++) {
+            if (lod.skipFactor > 1 && (idx % lod.skipFactor) != 0) continue;
 
-        if (zone.zoomLevel < 0.001 && cloud.type == GasType::CORONAL) continue;
+            const auto& cloud = gasClouds[darkLaneIndices[idx]];
+
+            // the outer layer is the widest sprite
+            if (!g_cameraView.pointVisible(cloud.x, cloud.y, cloud.z,
+                std::min(cloud.smoothingLength * 2.0f * 1.3f, MAX_POINT_SIZE))) continue;
+
+            for (int i = 0; i < lod.darkLaneLayers; i++) {
+                float darken, size;
+                darkLaneSplat(cloud, i, lod.darkLaneLayers, darken, size);
+                pointsBySize[sizeBinOf(size)].vertices.push_back({ cloud.x, cloud.y, cloud.z,
+                    darken, darken, darken, 1.0f });
+            }
+        }
 
-        const float smoothingLength04 = cloud.smoothingLength * 0.4f;
-        const float cosRotation = cos(cloud.rotationAngle);
-        const float sinRotation = sin(cloud.rotationAngle);
-        const float baseSize = cloud.smoothingLength * 1.2f;
-        const float baseSizeElongated = baseSize * (1.0f + cloud.elongation * 0.5f);
-        const float alpha08 = cloud.alpha * 0.8f;
-        const int numFilamentsHalf = numFilaments / 2;
+        drawSizeBins();
+    }
 
-        for (int f = 0; f < numFilaments; f++) {
-            const float filamentOffset = (f - numFilamentsHalf) * smoothingLength04;
-            const float offsetX = filamentOffset * cosRotation;
-            const float offsetZ = filamentOffset * sinRotation;
-            const float filamentFalloff = exp(-f * f * 0.8f);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-            for (int i = 0; i < numLayersPerFilament; i++) {
-                float t = i / (float)(numLayersPerFilament - 1);
+    for (size_t idx = 0; idx < emissiveIndices.size(); idx++) {
+        if (lod.skipFactor > 1 && (idx % lod.skipFactor) != 0) continue;
+
+        const auto& cloud = gasClouds[emissiveIndices[idx]];
 
-                float gaussian = exp(-t * t * 2.5f);
-                float alpha = alpha08 * gaussian * filamentFalloff;
+        if (!lod.drawCoronal && cloud.type == GasType::CORONAL) continue;
 
-                float size = baseSizeElongated * (1.0f + t * 0.2f);
+        const float maxSize = std::min(emissiveBaseSize(cloud) * 1.2f, MAX_POINT_SIZE);
 
-                int sizeBin = (int)(size / SIZE_BIN);
-                if (sizeBin < 0) sizeBin = 0;
-                if (sizeBin >= MAX_SIZE_BINS) sizeBin = MAX_SIZE_BINS - 1;
+        for (int f = 0; f < lod.numFilaments; f++) {
+            float offsetX, offsetZ, falloff;
+            emissiveFilament(cloud, f, lod.numFilaments, offsetX, offsetZ, falloff);
 
-                verticesBySize[sizeBin].push_back(cloud.x + offsetX);
-                verticesBySize[sizeBin].push_back(cloud.y);
-                verticesBySize[sizeBin].push_back(cloud.z + offsetZ);
+            if (!g_cameraView.pointVisible(cloud.x + offsetX, cloud.y, cloud.z + offsetZ, maxSize)) continue;
 
-                colorsBySize[sizeBin].push_back(cloud.r);
-                colorsBySize[sizeBin].push_back(cloud.g);
-                colorsBySize[sizeBin].push_back(cloud.b);
-                colorsBySize[sizeBin].push_back(alpha);
+            for (int i = 0; i < lod.layersPerFilament; i++) {
+                float alpha, size;
+                emissiveSplat(cloud, falloff, i, lod.layersPerFilament, alpha, size);
+                pointsBySize[sizeBinOf(size)].vertices.push_back({ cloud.x + offsetX, cloud.y, cloud.z + offsetZ,
+                    cloud.r, cloud.g, cloud.b, alpha });
             }
         }
     }
 
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_COLOR_ARRAY);
+    drawSizeBins();
+}
 
-    for (int sizeBin = 0; sizeBin < MAX_SIZE_BINS; sizeBin++) {
-        auto& vertices = verticesBySize[sizeBin];
-        auto& colors = colorsBySize[sizeBin];
+void renderGalacticGas(const std::vector<GasCloud>& gasClouds, const RenderZone& zone) {
+    glEnable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_POINT_SMOOTH);
 
-        if (vertices.empty()) continue;
+    GasLod lod = gasLod(zone);
 
-        glPointSize(sizeBin * SIZE_BIN);
-        glVertexPointer(3, GL_FLOAT, 0, vertices.data());
-        glColorPointer(4, GL_FLOAT, 0, colors.data());
-        glDrawArrays(GL_POINTS, 0, vertices.size() / 3);
+    if (g_renderBackend == RenderBackend::MODERN) {
+        if (gasProgram || initGasProgram()) {
+            renderGalacticGasModern(gasClouds, lod);
+        } else {
+            std::cout << "Gas shader unavailable, falling back to the fixed-function renderer" << std::endl;
+            g_renderBackend = RenderBackend::LEGACY;
+        }
+    }
+    if (g_renderBackend == RenderBackend::LEGACY) {
+        renderGalacticGasLegacy(gasClouds, lod);
     }
-
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_COLOR_ARRAY);
 
     glDisable(GL_POINT_SMOOTH);
     glEnable(GL_DEPTH_TEST);
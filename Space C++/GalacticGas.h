@@ -1,4 +1,5 @@
 #pragma once
+#include "OrbitalPhase.h"
 #include <vector>
 
 struct RenderZone;
@@ -24,11 +25,11 @@ struct GasCloud {
     float alpha;
 
     float orbitalRadius;     // distance from galactic center
-    float angle;             // current angle in XZ plane
+    OrbitalPhase phase;      // current angle in XZ plane
     float angularVelocity;   // rotation speed (radians per second)
 
     // turbulence = random small-scale motion
-    float turbulencePhase;   // random phase for animated turbulence
+    OrbitalPhase turbulencePhase; // random phase for animated turbulence
     float turbulenceSpeed;   // how fast the turbulence evolves
 
     bool isDarkLane;         // true for molecular clouds that absorb light (render as dark)
@@ -60,6 +61,13 @@ void generateGalacticGas(std::vector<GasCloud>& gasClouds, const GasConfig& conf
 void updateGalacticGas(std::vector<GasCloud>& gasClouds, double deltaTime);
 void renderGalacticGas(const std::vector<GasCloud>& gasClouds, const RenderZone& zone);
 
+// the modern renderer draws the gas into offscreen targets this fraction of the window
+// size and upsamples it over the stars, 1 draws it straight into the window
+extern float g_gasResolutionScale;
+
+// GPU time of the last measured gas pass in milliseconds, negative until there is one
+double gasPassMilliseconds();
+
 const float MOLECULAR_TEMP = 20.0f;          // 10-50 K
 const float COLD_NEUTRAL_TEMP = 80.0f;       // 50-100 K
 const float WARM_NEUTRAL_TEMP = 8000.0f;     // 6000-10000 K
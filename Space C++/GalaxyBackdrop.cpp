@@ -0,0 +1,330 @@
+#include "GalaxyBackdrop.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+// further from the solar system than this (world units, Neptune orbits at 4.5) the
+// galaxy is drawn as usual, the backdrop only holds for a view from the sun
+const double BACKDROP_MAX_DISTANCE = 10.0;
+
+// faces match the window's pixels up to this size
+const int BACKDROP_MAX_FACE_SIZE = 2048;
+
+// a face is stale once the stars around the sun have moved this far (world units), the
+// nearest few are a handful of units away and jump by a degree or so when it's redrawn
+const double BACKDROP_MAX_DRIFT = 0.1;
+
+const int NUM_BACKDROP_FACES = 6;
+
+// the rows of each face's view rotation, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order:
+// across the face, up the face, and back from it, as the cubemap lookup has them
+static const double BACKDROP_FACE_AXES[NUM_BACKDROP_FACES][3][3] = {
+	{ { 0, 0, -1 }, { 0, -1, 0 }, { -1, 0, 0 } },
+	{ { 0, 0, 1 }, { 0, -1, 0 }, { 1, 0, 0 } },
+	{ { 1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } },
+	{ { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+	{ { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 } },
+	{ { -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, 1 } }
+};
+
+struct BackdropFace {
+	bool valid = false;
+	double time = 0.0;		// stars.time it was baked at
+};
+
+static BackdropFace backdropFaces[NUM_BACKDROP_FACES];
+static int backdropFaceSize = 0;
+static unsigned int backdropGeneration = 0;
+static double backdropCenter[3] = { 0.0, 0.0, 0.0 };
+static bool backdropShown = false;		// last frame, a stale sky is baked all at once on the way in
+
+static GLuint backdropFramebuffer = 0;
+static GLuint backdropTexture = 0;
+static GLuint backdropDepth = 0;
+static GLuint backdropProgram = 0;
+static GLint backdropViewProjectionLocation = -1;
+static GLuint backdropVao = 0;
+static GLuint backdropVbo = 0;
+static bool backdropFailed = false;
+
+// a cube around the eye, only its directions matter. z stays inside the depth range
+// whatever the distance, the backdrop is behind everything by being drawn first
+static const char* BACKDROP_VERTEX_SHADER = R"(#version 330 core
+in vec3 aPosition;
+
+uniform mat4 uViewProjection;
+
+out vec3 vDirection;
+
+void main() {
+	vDirection = aPosition;
+	vec4 clip = uViewProjection * vec4(aPosition, 0.0);
+	gl_Position = vec4(clip.xy, 0.0, clip.w);
+}
+)";
+
+static const char* BACKDROP_FRAGMENT_SHADER = R"(#version 330 core
+in vec3 vDirection;
+
+uniform samplerCube uBackdrop;
+
+out vec4 fragColor;
+
+void main() {
+	fragColor = vec4(texture(uBackdrop, vDirection).rgb, 1.0);
+}
+)";
+
+static bool initBackdrop() {
+	backdropProgram = createShaderProgram("galaxy backdrop", BACKDROP_VERTEX_SHADER, BACKDROP_FRAGMENT_SHADER,
+		{ "aPosition" });
+	if (!backdropProgram) return false;
+	backdropViewProjectionLocation = glGetUniformLocation(backdropProgram, "uViewProjection");
+	glUseProgram(backdropProgram);
+	glUniform1i(glGetUniformLocation(backdropProgram, "uBackdrop"), 0);
+	glUseProgram(0);
+
+	// two triangles on each side of the cube
+	std::vector<float> vertices;
+	const float corners[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, -1 }, { 1, 1 }, { -1, 1 } };
+	for (int axis = 0; axis < 3; axis++) {
+		for (float side : { -1.0f, 1.0f }) {
+			for (const auto& corner : corners) {
+				float p[3];
+				p[axis] = side;
+				p[(axis + 1) % 3] = corner[0];
+				p[(axis + 2) % 3] = corner[1];
+				vertices.insert(vertices.end(), p, p + 3);
+			}
+		}
+	}
+	glGenVertexArrays(1, &backdropVao);
+	glGenBuffers(1, &backdropVbo);
+	glBindVertexArray(backdropVao);
+	glBindBuffer(GL_ARRAY_BUFFER, backdropVbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (const void*)0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenFramebuffers(1, &backdropFramebuffer);
+	glGenTextures(1, &backdropTexture);
+	glGenTextures(1, &backdropDepth);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	return true;
+}
+
+static void resizeBackdrop(int size) {
+	if (size == backdropFaceSize) return;
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, backdropTexture);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	for (int face = 0; face < NUM_BACKDROP_FACES; face++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	// the stars depth test against each other, one depth buffer does for every face
+	glBindTexture(GL_TEXTURE_2D, backdropDepth);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	backdropFaceSize = size;
+	for (BackdropFace& face : backdropFaces) face.valid = false;
+}
+
+// the galaxy seen from the solar system's centre through one face, at the best
+// refinement step since the camera's movements don't reach it
+static bool bakeBackdropFace(int face, const StarField& stars, const std::vector<GasCloud>& gasClouds) {
+	glBindFramebuffer(GL_FRAMEBUFFER, backdropFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, backdropTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, backdropDepth, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) return false;
+
+	CameraView& view = g_cameraView;
+	view.eyeX = backdropCenter[0];
+	view.eyeY = backdropCenter[1];
+	view.eyeZ = backdropCenter[2];
+	view.width = backdropFaceSize;
+	view.height = backdropFaceSize;
+
+	// 90 degrees square, with setupCamera's depth range
+	double nearPlane = 0.1;
+	double farPlane = 10000.0;
+	double projection[16] = {
+		1, 0, 0, 0,
+		0, 1, 0, 0,
+		0, 0, (farPlane + nearPlane) / (nearPlane - farPlane), -1,
+		0, 0, (2 * farPlane * nearPlane) / (nearPlane - farPlane), 0
+	};
+	const double (*axes)[3] = BACKDROP_FACE_AXES[face];
+	for (int i = 0; i < 16; i++) {
+		view.projection[i] = projection[i];
+		view.relativeView[i] = (i % 5 == 0) ? 1.0 : 0.0;
+	}
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) view.relativeView[col * 4 + row] = axes[row][col];
+	}
+	for (int i = 0; i < 16; i++) view.view[i] = view.relativeView[i];
+	for (int row = 0; row < 3; row++) {
+		view.view[12 + row] = -(axes[row][0] * view.eyeX + axes[row][1] * view.eyeY + axes[row][2] * view.eyeZ);
+	}
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			double sum = 0.0;
+			for (int k = 0; k < 4; k++) sum += view.projection[k * 4 + row] * view.view[col * 4 + k];
+			view.viewProjection[col * 4 + row] = sum;
+		}
+	}
+	view.frustum.extract(view.viewProjection);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixd(view.projection);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixd(view.view);
+	glViewport(0, 0, backdropFaceSize, backdropFaceSize);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// the galaxy as galaxy zoom draws it, the LODs don't see the system zoom
+	RenderZone zone;
+	zone.distanceFromSystem = 0.0;
+	zone.zoomLevel = 1.0;
+	zone.solarSystemScaleMultiplier = 1.0;
+	zone.starBrightnessFade = 1.0;
+	zone.renderOrbits = false;
+	renderStars(stars, zone);
+	renderGalacticGas(gasClouds, zone);
+
+	backdropFaces[face].valid = true;
+	backdropFaces[face].time = stars.time;
+	return true;
+}
+
+// bakes the faces that need it, all of them when all is true, else the stalest one
+static bool bakeBackdrop(const StarField& stars, const std::vector<GasCloud>& gasClouds, bool all) {
+	// how far the stars around the sun have moved since each face was baked
+	double orbitRadius = sqrt(backdropCenter[0] * backdropCenter[0] + backdropCenter[2] * backdropCenter[2]);
+	double speed = stars.angularVelocity((float)std::max(orbitRadius, (double)stars.bulgeRadius), false) * orbitRadius;
+
+	int faces[NUM_BACKDROP_FACES];
+	int count = 0;
+	double stalest = 0.0;
+	for (int face = 0; face < NUM_BACKDROP_FACES; face++) {
+		double drift = backdropFaces[face].valid ? speed * fabs(stars.time - backdropFaces[face].time) : INFINITY;
+		if (drift <= BACKDROP_MAX_DRIFT) continue;
+		if (all || !backdropFaces[face].valid) {
+			faces[count++] = face;
+		}
+		else if (count == 0 || drift > stalest) {
+			faces[0] = face;
+			count = 1;
+			stalest = drift;
+		}
+	}
+	if (count == 0) return true;
+
+	CameraView savedView = g_cameraView;
+	int savedRefinement = g_renderRefinement;
+	GLint savedViewport[4], savedFramebuffer;
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	g_renderRefinement = RENDER_REFINEMENT_STEPS;
+
+	bool baked = true;
+	for (int i = 0; i < count && baked; i++) {
+		baked = bakeBackdropFace(faces[i], stars, gasClouds);
+	}
+
+	g_renderRefinement = savedRefinement;
+	g_cameraView = savedView;
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixd(savedView.projection);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixd(savedView.view);
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	return baked;
+}
+
+static void drawBackdrop() {
+	// the view without the eye's position and zoom, neither changes a direction
+	const CameraView& view = g_cameraView;
+	float viewProjection[16];
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			double sum = 0.0;
+			for (int k = 0; k < 4; k++) sum += view.projection[k * 4 + row] * view.relativeView[col * 4 + k];
+			viewProjection[col * 4 + row] = (float)sum;
+		}
+	}
+
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+
+	glUseProgram(backdropProgram);
+	glUniformMatrix4fv(backdropViewProjectionLocation, 1, GL_FALSE, viewProjection);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, backdropTexture);
+	glBindVertexArray(backdropVao);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	glUseProgram(0);
+
+	if (blend) glEnable(GL_BLEND);
+	if (depthTest) glEnable(GL_DEPTH_TEST);
+}
+
+bool renderGalaxyBackdrop(const StarField& stars, const std::vector<GasCloud>& gasClouds, const RenderZone& zone) {
+	bool wasShown = backdropShown;
+	backdropShown = false;
+	if (g_renderBackend != RenderBackend::MODERN || backdropFailed || !solarSystem.isGenerated ||
+		zone.zoomLevel < SYSTEM_ZOOM_MIN) {
+		return false;
+	}
+
+	const CameraView& view = g_cameraView;
+	double dx = view.eyeX - solarSystem.centerX;
+	double dy = view.eyeY - solarSystem.centerY;
+	double dz = view.eyeZ - solarSystem.centerZ;
+	if (dx * dx + dy * dy + dz * dz > BACKDROP_MAX_DISTANCE * BACKDROP_MAX_DISTANCE) return false;
+
+	if (!backdropProgram && !initBackdrop()) {
+		std::cout << "Galaxy backdrop unavailable, drawing the galaxy at system zoom" << std::endl;
+		backdropFailed = true;
+		return false;
+	}
+
+	// the window's pixel density at the centre of a face
+	int size = std::min(BACKDROP_MAX_FACE_SIZE, (int)(view.height * view.projection[5] + 0.5));
+	resizeBackdrop(size);
+	if (backdropGeneration != stars.generation || backdropCenter[0] != solarSystem.centerX ||
+		backdropCenter[1] != solarSystem.centerY || backdropCenter[2] != solarSystem.centerZ) {
+		backdropGeneration = stars.generation;
+		backdropCenter[0] = solarSystem.centerX;
+		backdropCenter[1] = solarSystem.centerY;
+		backdropCenter[2] = solarSystem.centerZ;
+		for (BackdropFace& face : backdropFaces) face.valid = false;
+	}
+
+	if (!bakeBackdrop(stars, gasClouds, !wasShown)) {
+		std::cout << "Galaxy backdrop unavailable, drawing the galaxy at system zoom" << std::endl;
+		backdropFailed = true;
+		return false;
+	}
+
+	drawBackdrop();
+	backdropShown = true;
+	return true;
+}
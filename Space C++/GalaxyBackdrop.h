@@ -0,0 +1,14 @@
+#pragma once
+#include "Stars.h"
+#include "GalacticGas.h"
+#include "SolarSystem.h"
+#include <vector>
+
+// at system zoom the rest of the galaxy is as good as infinitely far away, so its stars
+// and gas are baked into a cubemap around the solar system and drawn behind it as a
+// skybox. a face is baked again once the galaxy has turned far enough since it was drawn,
+// one face a frame, so what a frame costs comes down to the solar system itself
+// modern backend only
+//
+// true when the backdrop was drawn, false when the stars and gas have to be drawn as usual
+bool renderGalaxyBackdrop(const StarField& stars, const std::vector<GasCloud>& gasClouds, const RenderZone& zone);
@@ -0,0 +1,424 @@
+#include "GalaxyImpostor.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+// the cache reaches this much further than the window each way, so turning the camera
+// a little still finds the galaxy in it
+const double IMPOSTOR_OVERSCAN = 1.25;
+const double IMPOSTOR_MAX_ERROR_PIXELS = 1.0;
+const int IMPOSTOR_MAX_AGE_FRAMES = 30;
+
+// closer than this many disk radii the galaxy is too deep for a single quad
+const double IMPOSTOR_MIN_DISTANCE = 3.0;
+
+enum class ImpostorMode {
+	DIRECT,
+	REFRESH,
+	CACHED
+};
+
+struct ImpostorCache {
+	bool valid = false;
+	int width = 0, height = 0;					// of the texture
+	int viewportWidth = 0, viewportHeight = 0;	// of the window it was drawn for
+	double viewProjection[16];					// the widened view it was drawn with
+	double inverseViewProjection[16];
+	double time = 0.0;							// stars.time it was drawn at
+	double maxSpeed = 0.0;						// fastest orbit, world units per simulated second
+	double extentRadius = 0.0, extentHeight = 0.0;	// half extents of the galaxy, across and up
+	unsigned int generation = 0;
+	int refinement = 0;
+	int age = 0;
+};
+
+static ImpostorCache impostor;
+static ImpostorMode impostorMode = ImpostorMode::DIRECT;
+static GLuint impostorFramebuffer = 0;
+static GLuint impostorTexture = 0;
+static GLuint impostorDepth = 0;
+static GLuint impostorProgram = 0;
+static GLint impostorMvpLocation = -1;
+static GLuint impostorVao = 0;
+static GLuint impostorVbo = 0;
+static bool impostorFailed = false;
+
+// what a refresh changed
+static CameraView savedView;
+static GLint savedViewport[4];
+static GLint savedFramebuffer = 0;
+
+static const char* IMPOSTOR_VERTEX_SHADER = R"(#version 330 core
+in vec3 aPosition;
+in vec2 aUv;
+
+uniform mat4 uMVP;
+
+out vec2 vUv;
+
+void main() {
+	vUv = aUv;
+	gl_Position = uMVP * vec4(aPosition, 1.0);
+}
+)";
+
+static const char* IMPOSTOR_FRAGMENT_SHADER = R"(#version 330 core
+in vec2 vUv;
+
+uniform sampler2D uImpostor;
+
+out vec4 fragColor;
+
+void main() {
+	fragColor = vec4(texture(uImpostor, vUv).rgb, 1.0);
+}
+)";
+
+static bool initImpostor() {
+	impostorProgram = createShaderProgram("galaxy impostor", IMPOSTOR_VERTEX_SHADER, IMPOSTOR_FRAGMENT_SHADER,
+		{ "aPosition", "aUv" });
+	if (!impostorProgram) return false;
+	impostorMvpLocation = glGetUniformLocation(impostorProgram, "uMVP");
+	glUseProgram(impostorProgram);
+	glUniform1i(glGetUniformLocation(impostorProgram, "uImpostor"), 0);
+	glUseProgram(0);
+
+	// four corners of position and uv, rewritten whenever the quad is drawn
+	glGenVertexArrays(1, &impostorVao);
+	glGenBuffers(1, &impostorVbo);
+	glBindVertexArray(impostorVao);
+	glBindBuffer(GL_ARRAY_BUFFER, impostorVbo);
+	glBufferData(GL_ARRAY_BUFFER, 4 * 5 * sizeof(float), nullptr, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (const void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (const void*)(3 * sizeof(float)));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenFramebuffers(1, &impostorFramebuffer);
+	glGenTextures(1, &impostorTexture);
+	glGenTextures(1, &impostorDepth);
+	return true;
+}
+
+static bool resizeImpostor(int width, int height) {
+	if (width == impostor.width && height == impostor.height) return true;
+
+	glBindTexture(GL_TEXTURE_2D, impostorTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	// the stars depth test against each other
+	glBindTexture(GL_TEXTURE_2D, impostorDepth);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint framebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, impostorFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, impostorDepth, 0);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	impostor.width = complete ? width : 0;
+	impostor.height = complete ? height : 0;
+	return complete;
+}
+
+// Gauss-Jordan with partial pivoting, false if m is singular
+static bool invertMatrix(const double m[16], double inverse[16]) {
+	double a[4][8];
+	for (int row = 0; row < 4; row++) {
+		for (int col = 0; col < 4; col++) {
+			a[row][col] = m[col * 4 + row];
+			a[row][col + 4] = row == col ? 1.0 : 0.0;
+		}
+	}
+	for (int col = 0; col < 4; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < 4; row++) {
+			if (fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+		}
+		if (a[pivot][col] == 0.0) return false;
+		std::swap(a[col], a[pivot]);
+
+		double scale = 1.0 / a[col][col];
+		for (int i = 0; i < 8; i++) a[col][i] *= scale;
+		for (int row = 0; row < 4; row++) {
+			if (row == col) continue;
+			double factor = a[row][col];
+			for (int i = 0; i < 8; i++) a[row][i] -= factor * a[col][i];
+		}
+	}
+	for (int row = 0; row < 4; row++) {
+		for (int col = 0; col < 4; col++) inverse[col * 4 + row] = a[row][col + 4];
+	}
+	return true;
+}
+
+static void transformPoint(const double m[16], const double p[4], double out[4]) {
+	for (int row = 0; row < 4; row++) {
+		out[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row] * p[3];
+	}
+}
+
+// window pixels of a world point, false behind the camera
+static bool projectToPixels(const CameraView& view, const double p[3], double& x, double& y) {
+	double world[4] = { p[0], p[1], p[2], 1.0 };
+	double clip[4];
+	transformPoint(view.viewProjection, world, clip);
+	if (clip[3] <= 0.0) return false;
+	x = (clip[0] / clip[3] * 0.5 + 0.5) * view.width;
+	y = (clip[1] / clip[3] * 0.5 + 0.5) * view.height;
+	return true;
+}
+
+// the point of the quad the cache shows p on: its ray from the cache's eye meets the
+// plane through the galactic centre at the centre's depth
+// (points at one clip z and w are one view depth apart from the eye)
+static bool impostorPoint(const double p[3], double out[3]) {
+	const double* m = impostor.viewProjection;
+	double world[4] = { p[0], p[1], p[2], 1.0 };
+	double clip[4];
+	transformPoint(m, world, clip);
+	if (clip[3] <= 0.0) return false;
+
+	double onPlane[4] = { clip[0] / clip[3] * m[15], clip[1] / clip[3] * m[15], m[14], m[15] };
+	double result[4];
+	transformPoint(impostor.inverseViewProjection, onPlane, result);
+	if (result[3] == 0.0) return false;
+	for (int i = 0; i < 3; i++) out[i] = result[i] / result[3];
+	return true;
+}
+
+// the quad's corners, the cache's edges at the depth of the galactic centre
+static bool impostorCorners(double corners[4][3]) {
+	const double* m = impostor.viewProjection;
+	const double ndc[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+	for (int i = 0; i < 4; i++) {
+		double clip[4] = { ndc[i][0] * m[15], ndc[i][1] * m[15], m[14], m[15] };
+		double world[4];
+		transformPoint(impostor.inverseViewProjection, clip, world);
+		if (world[3] == 0.0) return false;
+		for (int k = 0; k < 3; k++) corners[i][k] = world[k] / world[3];
+	}
+	return true;
+}
+
+// how many pixels off the cached image is for the current view, infinite when it
+// can't stand in for the galaxy at all
+static double reprojectionError(double time) {
+	const CameraView& view = g_cameraView;
+
+	// the whole window has to land on the quad
+	double corners[4][3], pixels[4][2];
+	if (!impostorCorners(corners)) return INFINITY;
+	for (int i = 0; i < 4; i++) {
+		if (!projectToPixels(view, corners[i], pixels[i][0], pixels[i][1])) return INFINITY;
+	}
+	const double windowCorners[4][2] = { { 0, 0 }, { (double)view.width, 0 },
+		{ (double)view.width, (double)view.height }, { 0, (double)view.height } };
+	for (const auto& corner : windowCorners) {
+		for (int i = 0; i < 4; i++) {
+			const double* a = pixels[i];
+			const double* b = pixels[(i + 1) % 4];
+			if ((b[0] - a[0]) * (corner[1] - a[1]) - (b[1] - a[1]) * (corner[0] - a[0]) < 0.0) return INFINITY;
+		}
+	}
+
+	// parallax: the galaxy's bounding box as it is against where the quad shows it
+	double error = 0.0;
+	const double radius = impostor.extentRadius;
+	const double height = impostor.extentHeight;
+	for (int i = 0; i < 8; i++) {
+		double p[3] = { (i & 1) ? radius : -radius, (i & 2) ? height : -height, (i & 4) ? radius : -radius };
+		double shown[3];
+		double x, y, shownX, shownY;
+		if (!impostorPoint(p, shown) || !projectToPixels(view, p, x, y) ||
+			!projectToPixels(view, shown, shownX, shownY)) {
+			return INFINITY;
+		}
+		error = std::max(error, hypot(x - shownX, y - shownY));
+	}
+
+	// the orbits since the cache was drawn, at the scale of the galactic centre
+	const double* rv = view.relativeView;
+	double zoom = sqrt(rv[0] * rv[0] + rv[1] * rv[1] + rv[2] * rv[2]);
+	double pixelsPerUnit = 0.5 * view.height * view.projection[5] * zoom / view.viewProjection[15];
+	error += impostor.maxSpeed * fabs(time - impostor.time) * pixelsPerUnit;
+	return error;
+}
+
+// world units per simulated second of the fastest star or cloud
+static double fastestOrbit(const StarField& stars, const std::vector<GasCloud>& gasClouds) {
+	double speed = stars.angularVelocity(stars.bulgeRadius, true) * stars.bulgeRadius;
+	const int samples = 16;
+	for (int i = 0; i <= samples; i++) {
+		float r = stars.bulgeRadius + (stars.diskRadius - stars.bulgeRadius) * i / samples;
+		speed = std::max(speed, (double)(stars.angularVelocity(r, false) * r));
+	}
+	for (const GasCloud& cloud : gasClouds) {
+		speed = std::max(speed, (double)(fabsf(cloud.angularVelocity) * cloud.orbitalRadius));
+	}
+	return speed;
+}
+
+// the box the parallax is measured on, the halo clouds reach well above the disk
+static void galaxyExtent(const StarField& stars, const std::vector<GasCloud>& gasClouds, double& radius, double& height) {
+	radius = stars.diskRadius;
+	height = stars.diskRadius * 0.125;
+	for (const GasCloud& cloud : gasClouds) {
+		radius = std::max(radius, (double)cloud.orbitalRadius);
+		height = std::max(height, (double)fabsf(cloud.y));
+	}
+}
+
+bool beginGalaxyImpostor(const StarField& stars, const std::vector<GasCloud>& gasClouds) {
+	impostorMode = ImpostorMode::DIRECT;
+	if (g_renderBackend != RenderBackend::MODERN || impostorFailed) return true;
+
+	const CameraView& view = g_cameraView;
+	double distance = sqrt(view.eyeX * view.eyeX + view.eyeY * view.eyeY + view.eyeZ * view.eyeZ);
+	if (distance < IMPOSTOR_MIN_DISTANCE * stars.diskRadius || view.viewProjection[15] <= 0.0) {
+		impostor.valid = false;
+		return true;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// a better refinement step than the cache was drawn at is worth drawing
+	if (impostor.valid && impostor.viewportWidth == viewport[2] && impostor.viewportHeight == viewport[3] &&
+		impostor.generation == stars.generation && g_renderRefinement <= impostor.refinement &&
+		impostor.age < IMPOSTOR_MAX_AGE_FRAMES && reprojectionError(stars.time) <= IMPOSTOR_MAX_ERROR_PIXELS) {
+		impostorMode = ImpostorMode::CACHED;
+		return false;
+	}
+
+	// an even margin keeps the window's pixels on the cache's texel centres
+	int width = viewport[2] + 2 * (int)(viewport[2] * (IMPOSTOR_OVERSCAN - 1.0) * 0.5 + 0.5);
+	int height = viewport[3] + 2 * (int)(viewport[3] * (IMPOSTOR_OVERSCAN - 1.0) * 0.5 + 0.5);
+	if (!(impostorProgram || initImpostor()) || !resizeImpostor(width, height)) {
+		std::cout << "Galaxy impostor unavailable, drawing the galaxy every frame" << std::endl;
+		impostorFailed = true;
+		impostor.valid = false;
+		return true;
+	}
+
+	// the same view over the larger area: the projection's x and y shrink by as much
+	// as the texture outgrows the window, the pixels stay the same size
+	savedView = view;
+	CameraView& widened = g_cameraView;
+	double scaleX = (double)viewport[2] / width;
+	double scaleY = (double)viewport[3] / height;
+	for (int col = 0; col < 4; col++) {
+		widened.projection[col * 4 + 0] *= scaleX;
+		widened.projection[col * 4 + 1] *= scaleY;
+		widened.viewProjection[col * 4 + 0] *= scaleX;
+		widened.viewProjection[col * 4 + 1] *= scaleY;
+	}
+	widened.frustum.extract(widened.viewProjection);
+	widened.width = width;
+	widened.height = height;
+
+	if (!invertMatrix(widened.viewProjection, impostor.inverseViewProjection)) {
+		g_cameraView = savedView;
+		impostor.valid = false;
+		return true;
+	}
+	for (int i = 0; i < 16; i++) impostor.viewProjection[i] = widened.viewProjection[i];
+	impostor.viewportWidth = viewport[2];
+	impostor.viewportHeight = viewport[3];
+	impostor.time = stars.time;
+	impostor.maxSpeed = fastestOrbit(stars, gasClouds);
+	galaxyExtent(stars, gasClouds, impostor.extentRadius, impostor.extentHeight);
+	impostor.generation = stars.generation;
+	impostor.refinement = g_renderRefinement;
+	impostor.age = 0;
+	impostor.valid = true;
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixd(widened.projection);
+	glMatrixMode(GL_MODELVIEW);
+
+	for (int i = 0; i < 4; i++) savedViewport[i] = viewport[i];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, impostorFramebuffer);
+	glViewport(0, 0, width, height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	impostorMode = ImpostorMode::REFRESH;
+	return true;
+}
+
+static void drawImpostor() {
+	double corners[4][3];
+	if (!impostorCorners(corners)) return;
+
+	// relative to the eye like every other near-camera geometry, see loadCameraRelative
+	const CameraView& view = g_cameraView;
+	const float uvs[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+	float vertices[4 * 5];
+	for (int i = 0; i < 4; i++) {
+		vertices[i * 5 + 0] = (float)(corners[i][0] - view.eyeX);
+		vertices[i * 5 + 1] = (float)(corners[i][1] - view.eyeY);
+		vertices[i * 5 + 2] = (float)(corners[i][2] - view.eyeZ);
+		vertices[i * 5 + 3] = uvs[i][0];
+		vertices[i * 5 + 4] = uvs[i][1];
+	}
+
+	float mvp[16];
+	glPushMatrix();
+	loadCameraRelative(view.eyeX, view.eyeY, view.eyeZ);
+	getModelViewProjection(mvp);
+	glPopMatrix();
+
+	// the cache already holds the cleared background, so it replaces the frame outright
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+
+	glUseProgram(impostorProgram);
+	glUniformMatrix4fv(impostorMvpLocation, 1, GL_FALSE, mvp);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, impostorTexture);
+	glBindBuffer(GL_ARRAY_BUFFER, impostorVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(impostorVao);
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+
+	if (blend) glEnable(GL_BLEND);
+	if (depthTest) glEnable(GL_DEPTH_TEST);
+}
+
+void endGalaxyImpostor() {
+	if (impostorMode == ImpostorMode::DIRECT) return;
+
+	if (impostorMode == ImpostorMode::REFRESH) {
+		g_cameraView = savedView;
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixd(savedView.projection);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixd(savedView.view);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+		glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	}
+
+	drawImpostor();
+	impostor.age++;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "Stars.h"
+#include "GalacticGas.h"
+#include <vector>
+
+// far outside the galaxy its stars and gas hardly change from one frame to the next, so
+// they're drawn into a cached image a little larger than the window and shown as a quad
+// through the galactic centre, facing the camera the cache was drawn from. the cache is
+// redrawn once the quad would put part of the galaxy more than a pixel off (parallax,
+// the galaxy's rotation), the window runs past its edge, or it gets too old
+// modern backend only
+//
+// true when the galaxy has to be drawn now (into the cache or straight into the frame),
+// false when the cached image will do. endGalaxyImpostor is called either way
+bool beginGalaxyImpostor(const StarField& stars, const std::vector<GasCloud>& gasClouds);
+void endGalaxyImpostor();
@@ -1,5 +1,7 @@
 #include "Input.h"
 #include "UI.h"
+#include "GalacticGas.h"
+#include "Window.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <random>
@@ -8,6 +10,8 @@ static Camera* g_camera = nullptr;
 static MouseState* g_mouseState = nullptr;
 static UIState* g_uiState = nullptr;
 
+bool g_logFrameTimes = false;
+
 void setGlobalCamera(Camera* cam) {
 	g_camera = cam;
 }
@@ -21,6 +25,8 @@ void setGlobalUIState(UIState* ui) {
 }
 
 void mouseMoveCallback(GLFWwindow* window, double xpos, double ypos) {
+	// the UI's hover highlight follows the cursor too
+	g_redrawRequested = true;
 	if (!g_camera || !g_mouseState) return;
 
 	if (g_uiState && g_uiState->isVisible) return;
@@ -45,6 +51,7 @@ void mouseMoveCallback(GLFWwindow* window, double xpos, double ypos) {
 }
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+	g_redrawRequested = true;
 	if (!g_camera) return;
 
 	if (g_uiState && g_uiState->isVisible) return;
@@ -69,8 +76,26 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
 }
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	g_redrawRequested = true;
 	if (!g_camera) return;
 	if (action != GLFW_PRESS) return;
+
+	// G steps the gas through full, half and quarter resolution
+	if (key == GLFW_KEY_G) {
+		if (g_gasResolutionScale >= 1.0f) g_gasResolutionScale = 0.5f;
+		else if (g_gasResolutionScale >= 0.5f) g_gasResolutionScale = 0.25f;
+		else g_gasResolutionScale = 1.0f;
+		std::cout << "Gas resolution: " << g_gasResolutionScale << std::endl;
+	}
+
+	if (key == GLFW_KEY_F) {
+		g_logFrameTimes = !g_logFrameTimes;
+	}
+}
+
+// the UI polls the buttons itself, this only wakes the main loop so it sees them
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+	g_redrawRequested = true;
 }
 
 void initInput(GLFWwindow* window, Camera& camera, MouseState& mouseState) {
@@ -81,4 +106,5 @@ void initInput(GLFWwindow* window, Camera& camera, MouseState& mouseState) {
 	glfwSetCursorPosCallback(window, mouseMoveCallback);
 	glfwSetScrollCallback(window, scrollCallback);
 	glfwSetKeyCallback(window, keyCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
 }
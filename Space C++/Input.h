@@ -17,7 +17,11 @@ void initInput(struct GLFWwindow* window, Camera& camera, MouseState& mouseState
 void mouseMoveCallback(struct GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(struct GLFWwindow* window, double xoffset, double yoffset);
 void keyCallback(struct GLFWwindow* window, int key, int scancode, int action, int mods);
+void mouseButtonCallback(struct GLFWwindow* window, int button, int action, int mods);
 
 void setGlobalCamera(Camera* cam);
 void setGlobalMouseState(MouseState* ms);
 void setGlobalUIState(UIState* ui);
+
+// F toggles it: the main loop prints average frame times once a second
+extern bool g_logFrameTimes;
@@ -0,0 +1,260 @@
+#include "Lensing.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "Parallel.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef GL_R32F
+#define GL_R32F 0x822E
+#endif
+
+// deflection of a light ray passing a Schwarzschild mass, by x = bCritical / b for
+// impact parameter b. in units of the Schwarzschild radius the geodesics don't depend
+// on the mass, so one table serves every black hole
+// x = 0 is a ray at infinity (no deflection), x = 1 one that grazes the photon sphere
+const int DEFLECTION_TABLE_SIZE = 1024;
+const double CRITICAL_IMPACT_PARAMETER = 1.5 * 1.7320508075688772;	// 3 sqrt(3) / 2 rs
+const double MAX_DEFLECTION = 6.0 * M_PI;
+
+// integrates u'' + u = 3/2 u^2 (u = rs / r against the orbit angle) in from infinity
+// to periapsis, the ray comes out as far past the straight line as it turned going in
+static double deflectionAngle(double impactParameter) {
+	const double step = 1.0e-4;
+	auto acceleration = [](double u) { return 1.5 * u * u - u; };
+
+	double u = 0.0, du = 1.0 / impactParameter, angle = 0.0;
+	while (angle < 0.5 * (M_PI + MAX_DEFLECTION)) {
+		// RK4
+		double k1u = du, k1d = acceleration(u);
+		double k2u = du + 0.5 * step * k1d, k2d = acceleration(u + 0.5 * step * k1u);
+		double k3u = du + 0.5 * step * k2d, k3d = acceleration(u + 0.5 * step * k2u);
+		double k4u = du + step * k3d, k4d = acceleration(u + step * k3u);
+		double nextU = u + step / 6.0 * (k1u + 2.0 * k2u + 2.0 * k3u + k4u);
+		double nextDu = du + step / 6.0 * (k1d + 2.0 * k2d + 2.0 * k3d + k4d);
+
+		if (nextDu <= 0.0) {
+			// periapsis inside this step, where du crosses zero
+			double periapsis = angle + step * du / (du - nextDu);
+			return std::min(2.0 * periapsis - M_PI, MAX_DEFLECTION);
+		}
+		if (nextU > 1.0) break;	// inside the horizon, only rounding gets a ray here
+
+		u = nextU;
+		du = nextDu;
+		angle += step;
+	}
+	return MAX_DEFLECTION;
+}
+
+static void buildDeflectionTable(std::vector<float>& table) {
+	table.resize(DEFLECTION_TABLE_SIZE);
+	table[0] = 0.0f;
+	parallelFor(DEFLECTION_TABLE_SIZE - 1, [&](int i) {
+		double x = (i + 1) / (double)(DEFLECTION_TABLE_SIZE - 1);
+		table[i + 1] = (float)deflectionAngle(CRITICAL_IMPACT_PARAMETER / x);
+	});
+}
+
+static GLuint lensProgram = 0;
+static GLint lensSceneLocation = -1;
+static GLint lensDeflectionLocation = -1;
+static GLint lensViewportLocation = -1;
+static GLint lensFocalLengthLocation = -1;
+static GLint lensCountLocation = -1;
+static GLint lensCentersLocation = -1;
+static GLint lensCriticalLocation = -1;
+static GLuint lensVao = 0;	// no attributes, but a VAO has to be bound to draw
+static GLuint deflectionTexture = 0;
+static GLuint sceneTexture = 0;
+static GLsizei sceneWidth = 0, sceneHeight = 0;
+static bool lensingFailed = false;
+
+static const char* LENS_VERTEX_SHADER = R"(#version 330 core
+void main() {
+	// one triangle over the whole viewport
+	vec2 corner = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+	gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+static const char* LENS_FRAGMENT_SHADER = R"(#version 330 core
+const int MAX_LENSES = 4;
+const float TABLE_SIZE = 1024.0;
+
+uniform sampler2D uScene;
+uniform sampler1D uDeflection;
+uniform vec4 uViewport;
+uniform float uFocalLength;		// in pixels
+uniform int uLenses;
+uniform vec2 uLensCenters[MAX_LENSES];	// window pixels
+uniform float uLensCritical[MAX_LENSES];	// critical impact parameter over the distance
+
+out vec4 fragColor;
+
+void main() {
+	vec2 pixel = gl_FragCoord.xy;
+	vec2 source = pixel;
+
+	for (int i = 0; i < uLenses; i++) {
+		vec2 offset = pixel - uLensCenters[i];
+		float r = length(offset);
+
+		// the ray's angle from the lens and its impact parameter, relative to the critical one
+		float theta = atan(r / uFocalLength);
+		float x = uLensCritical[i] / sin(theta);
+		if (!(x < 1.0)) {
+			fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+			return;
+		}
+
+		float deflection = texture(uDeflection, (x * (TABLE_SIZE - 1.0) + 0.5) / TABLE_SIZE).r;
+		float sourceTheta = clamp(theta - deflection, -1.5, 1.5);
+		source += offset / r * (uFocalLength * tan(sourceTheta) - r);
+	}
+
+	fragColor = vec4(texture(uScene, (source - uViewport.xy) / uViewport.zw).rgb, 1.0);
+}
+)";
+
+static bool initLensing() {
+	lensProgram = createShaderProgram("lens", LENS_VERTEX_SHADER, LENS_FRAGMENT_SHADER, {});
+	if (!lensProgram) return false;
+
+	lensSceneLocation = glGetUniformLocation(lensProgram, "uScene");
+	lensDeflectionLocation = glGetUniformLocation(lensProgram, "uDeflection");
+	lensViewportLocation = glGetUniformLocation(lensProgram, "uViewport");
+	lensFocalLengthLocation = glGetUniformLocation(lensProgram, "uFocalLength");
+	lensCountLocation = glGetUniformLocation(lensProgram, "uLenses");
+	lensCentersLocation = glGetUniformLocation(lensProgram, "uLensCenters");
+	lensCriticalLocation = glGetUniformLocation(lensProgram, "uLensCritical");
+	glGenVertexArrays(1, &lensVao);
+
+	std::vector<float> table;
+	buildDeflectionTable(table);
+
+	glGenTextures(1, &deflectionTexture);
+	glBindTexture(GL_TEXTURE_1D, deflectionTexture);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, DEFLECTION_TABLE_SIZE, 0, GL_RED, GL_FLOAT, table.data());
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D, 0);
+
+	glGenTextures(1, &sceneTexture);
+	glBindTexture(GL_TEXTURE_2D, sceneTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return true;
+}
+
+bool renderLensing(const std::vector<Lens>& lenses) {
+	if (g_renderBackend != RenderBackend::MODERN || lensingFailed) return false;
+	if (!lensProgram && !initLensing()) {
+		std::cout << "Lensing shader unavailable, drawing the photon rings instead" << std::endl;
+		lensingFailed = true;
+		return false;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	const CameraView& view = g_cameraView;
+	const float focalLength = (float)(view.projection[5] * viewport[3] * 0.5);
+
+	// lenses in front of the camera, nearest first
+	struct ScreenLens {
+		double distance;
+		float centerX, centerY, critical;
+	};
+	static std::vector<ScreenLens> screenLenses;
+	screenLenses.clear();
+	for (const Lens& lens : lenses) {
+		const double* m = view.viewProjection;
+		double clipX = m[0] * lens.x + m[4] * lens.y + m[8] * lens.z + m[12];
+		double clipY = m[1] * lens.x + m[5] * lens.y + m[9] * lens.z + m[13];
+		double clipW = m[3] * lens.x + m[7] * lens.y + m[11] * lens.z + m[15];
+		if (clipW <= 0.0) continue;
+
+		double dx = lens.x - view.eyeX, dy = lens.y - view.eyeY, dz = lens.z - view.eyeZ;
+		double distance = sqrt(dx * dx + dy * dy + dz * dz);
+		double critical = CRITICAL_IMPACT_PARAMETER * lens.schwarzschildRadius / std::max(distance, 1.0e-9);
+
+		// a shadow under half a pixel covers no pixel centre
+		if (focalLength * critical < 0.5) continue;
+
+		// far from the lens the deflection falls off as 2 rs / b, which moves a pixel by
+		// 2 focal^2 critical / (bCritical r), so past the radius where that's half a pixel
+		// the lens changes nothing. skipped when that disk misses the viewport entirely
+		double centerX = viewport[0] + (clipX / clipW * 0.5 + 0.5) * viewport[2];
+		double centerY = viewport[1] + (clipY / clipW * 0.5 + 0.5) * viewport[3];
+		double influence = 4.0 * focalLength * focalLength * critical / CRITICAL_IMPACT_PARAMETER;
+		double outsideX = std::max({ viewport[0] - centerX, centerX - (viewport[0] + viewport[2]), 0.0 });
+		double outsideY = std::max({ viewport[1] - centerY, centerY - (viewport[1] + viewport[3]), 0.0 });
+		if (outsideX * outsideX + outsideY * outsideY > influence * influence) continue;
+
+		screenLenses.push_back({ distance, (float)centerX, (float)centerY, (float)critical });
+	}
+	// nothing on screen is bent, so the frame is left as it is without copying it
+	if (screenLenses.empty()) return true;
+
+	int numLenses = std::min((int)screenLenses.size(), MAX_LENSES);
+	std::partial_sort(screenLenses.begin(), screenLenses.begin() + numLenses, screenLenses.end(),
+		[](const ScreenLens& a, const ScreenLens& b) { return a.distance < b.distance; });
+
+	float centers[MAX_LENSES * 2], critical[MAX_LENSES];
+	for (int i = 0; i < numLenses; i++) {
+		centers[i * 2 + 0] = screenLenses[i].centerX;
+		centers[i * 2 + 1] = screenLenses[i].centerY;
+		critical[i] = screenLenses[i].critical;
+	}
+
+	// the frame so far becomes the source image
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sceneTexture);
+	if (sceneWidth != viewport[2] || sceneHeight != viewport[3]) {
+		sceneWidth = viewport[2];
+		sceneHeight = viewport[3];
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, sceneWidth, sceneHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_1D, deflectionTexture);
+
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+
+	glUseProgram(lensProgram);
+	glUniform1i(lensSceneLocation, 0);
+	glUniform1i(lensDeflectionLocation, 1);
+	glUniform4f(lensViewportLocation, (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+	glUniform1f(lensFocalLengthLocation, focalLength);
+	glUniform1i(lensCountLocation, numLenses);
+	glUniform2fv(lensCentersLocation, numLenses, centers);
+	glUniform1fv(lensCriticalLocation, numLenses, critical);
+
+	glBindVertexArray(lensVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glDepthMask(GL_TRUE);
+	if (depthTest) glEnable(GL_DEPTH_TEST);
+	if (blend) glEnable(GL_BLEND);
+
+	glBindTexture(GL_TEXTURE_1D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return true;
+}
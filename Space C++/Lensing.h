@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+
+// a point mass bending the light of everything behind it
+struct Lens {
+	float x, y, z;
+	float schwarzschildRadius;
+};
+
+// the nearest this many lenses in front of the camera are applied
+const int MAX_LENSES = 4;
+
+// resamples the frame drawn so far through the lenses' deflection: one copy of the
+// framebuffer and one fullscreen pass, whatever falls inside a photon sphere goes black
+// modern backend only, returns false (and draws nothing) when the pass isn't available
+bool renderLensing(const std::vector<Lens>& lenses);
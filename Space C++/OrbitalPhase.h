@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// AVX2 + FMA when the compiler targets it (/arch:AVX2, -mavx2 -mfma), SSE2 is baseline on x64
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#include <immintrin.h>
+#define PHASE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PHASE_SSE2
+#endif
+
+// orbital angle as a fixed-point fraction of a turn, 2^32 units per turn
+// integer adds wrap around the circle for free, so there's no normalisation and
+// no precision loss however long the simulation runs
+typedef uint32_t OrbitalPhase;
+
+const double PHASE_UNITS_PER_TURN = 4294967296.0;
+const float PHASE_TO_RADIANS = (float)(2.0 * M_PI / PHASE_UNITS_PER_TURN);
+
+inline OrbitalPhase phaseFromRadians(double radians) {
+	double turns = radians / (2.0 * M_PI);
+	turns -= floor(turns);
+	return (OrbitalPhase)(uint64_t)(turns * PHASE_UNITS_PER_TURN);
+}
+
+// [-PI, PI)
+inline double phaseToRadians(OrbitalPhase phase) {
+	return (int32_t)phase * (2.0 * M_PI / PHASE_UNITS_PER_TURN);
+}
+
+// how far something moving at radiansPerSecond gets in deltaTime, wrapped to one turn
+inline OrbitalPhase phaseStep(double radiansPerSecond, double deltaTime) {
+	return phaseFromRadians(radiansPerSecond * deltaTime);
+}
+
+// sin/cos straight from the phase: the top bits pick the nearest quarter turn exactly,
+// the rest is within +-PI/4 and goes through the cephes minimax polynomials
+const float SIN_C1 = -1.6666654611e-1f;
+const float SIN_C2 = 8.3321608736e-3f;
+const float SIN_C3 = -1.9515295891e-4f;
+const float COS_C1 = 4.166664568298827e-2f;
+const float COS_C2 = -1.388731625493765e-3f;
+const float COS_C3 = 2.443315711809948e-5f;
+
+inline void phaseSinCos(OrbitalPhase phase, float& s, float& c) {
+	uint32_t q = (phase + 0x20000000u) >> 30;
+	float r = (int32_t)(phase - (q << 30)) * PHASE_TO_RADIANS;
+	float r2 = r * r;
+
+	float ps = r + r * r2 * (SIN_C1 + r2 * (SIN_C2 + r2 * SIN_C3));
+	float pc = 1.0f - 0.5f * r2 + r2 * r2 * (COS_C1 + r2 * (COS_C2 + r2 * COS_C3));
+
+	float sq = (q & 1) ? pc : ps;
+	float cq = (q & 1) ? ps : pc;
+	s = (q & 2) ? -sq : sq;
+	c = ((q + 1) & 2) ? -cq : cq;
+}
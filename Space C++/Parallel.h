@@ -0,0 +1,33 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// runs task(i) for every i in [0, numTasks), numThreads = 0 uses all hardware threads
+// tasks are handed out one at a time, so a task must only depend on its index
+// (never on which thread runs it or in what order)
+template <typename Task>
+void parallelFor(int numTasks, const Task& task, int numThreads = 0) {
+	if (numThreads <= 0) numThreads = (int)std::thread::hardware_concurrency();
+	numThreads = std::max(1, std::min(numThreads, numTasks));
+
+	std::atomic<int> nextTask(0);
+	auto worker = [&]() {
+		for (int i = nextTask++; i < numTasks; i = nextTask++) {
+			task(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (int t = 1; t < numThreads; t++) {
+		threads.emplace_back(worker);
+	}
+
+	worker(); // calling thread works too
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
@@ -0,0 +1,315 @@
+#include "Renderer.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+RenderBackend g_renderBackend = RenderBackend::LEGACY;
+int g_renderRefinement = 0;
+
+// shared program for VertexBatch: position + colour, optionally round points
+static GLuint batchProgram = 0;
+static GLint batchMvpLocation = -1;
+static GLint batchRoundPointsLocation = -1;
+static GLint batchViewportLocation = -1;
+static GLint batchPointSizeLocation = -1;
+static GLuint batchVao = 0;
+static GLuint batchVbo = 0;
+
+static const char* BATCH_VERTEX_SHADER = R"(#version 330 core
+in vec3 aPosition;
+in vec4 aColor;
+
+uniform mat4 uMVP;
+uniform vec4 uViewport;
+uniform float uPointSize;
+
+out vec4 vColor;
+flat out vec2 vPointCenter;
+
+void main() {
+	vColor = aColor;
+	gl_Position = uMVP * vec4(aPosition, 1.0);
+	gl_PointSize = uPointSize;
+	vPointCenter = (gl_Position.xy / gl_Position.w * 0.5 + 0.5) * uViewport.zw + uViewport.xy;
+}
+)";
+
+static const char* BATCH_FRAGMENT_SHADER = R"(#version 330 core
+in vec4 vColor;
+flat in vec2 vPointCenter;
+
+uniform bool uRoundPoints;
+uniform float uPointSize;
+
+out vec4 fragColor;
+
+void main() {
+	float alpha = vColor.a;
+
+	// the antialiased disc GL_POINT_SMOOTH gives fixed-function points, for drivers that
+	// only smooth fixed-function points. measured in window space, no point sprites needed
+	if (uRoundPoints) {
+		float coverage = clamp(uPointSize * 0.5 - length(gl_FragCoord.xy - vPointCenter) + 0.5, 0.0, 1.0);
+		if (coverage <= 0.0) discard;
+		alpha *= coverage;
+	}
+
+	fragColor = vec4(vColor.rgb, alpha);
+}
+)";
+
+static bool hasOpenGL33() {
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (!version) return false;
+
+	char* end = nullptr;
+	long major = strtol(version, &end, 10);
+	long minor = (*end == '.') ? strtol(end + 1, nullptr, 10) : 0;
+	return major > 3 || (major == 3 && minor >= 3);
+}
+
+static GLuint compileShader(const char* name, GLenum type, const char* source) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
+	GLint status = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char log[2048];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		std::cerr << "Failed to compile " << name
+			<< (type == GL_VERTEX_SHADER ? " vertex" : " fragment") << " shader:\n" << log << std::endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+GLuint createShaderProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+	const std::vector<const char*>& attributeNames) {
+	GLuint vertexShader = compileShader(name, GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = compileShader(name, GL_FRAGMENT_SHADER, fragmentSource);
+	if (!vertexShader || !fragmentShader) {
+		if (vertexShader) glDeleteShader(vertexShader);
+		if (fragmentShader) glDeleteShader(fragmentShader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	for (size_t i = 0; i < attributeNames.size(); i++) {
+		glBindAttribLocation(program, (GLuint)i, attributeNames[i]);
+	}
+	glLinkProgram(program);
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint status = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		char log[2048];
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		std::cerr << "Failed to link " << name << " program:\n" << log << std::endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+void initRenderer() {
+	g_renderBackend = RenderBackend::LEGACY;
+
+	if (!hasOpenGL33() || !loadGLFunctions()) {
+		std::cout << "OpenGL 3.3 not available, using the fixed-function renderer" << std::endl;
+		return;
+	}
+
+	batchProgram = createShaderProgram("batch", BATCH_VERTEX_SHADER, BATCH_FRAGMENT_SHADER,
+		{ "aPosition", "aColor" });
+	if (!batchProgram) {
+		std::cout << "Falling back to the fixed-function renderer" << std::endl;
+		return;
+	}
+	batchMvpLocation = glGetUniformLocation(batchProgram, "uMVP");
+	batchRoundPointsLocation = glGetUniformLocation(batchProgram, "uRoundPoints");
+	batchViewportLocation = glGetUniformLocation(batchProgram, "uViewport");
+	batchPointSizeLocation = glGetUniformLocation(batchProgram, "uPointSize");
+
+	glGenVertexArrays(1, &batchVao);
+	glGenBuffers(1, &batchVbo);
+	glBindVertexArray(batchVao);
+	glBindBuffer(GL_ARRAY_BUFFER, batchVbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, x));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, r));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	g_renderBackend = RenderBackend::MODERN;
+	std::cout << "Using the OpenGL 3.3 renderer" << std::endl;
+}
+
+void getModelViewProjection(float mvp[16]) {
+	float projection[16], modelView[16];
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++) {
+				sum += projection[k * 4 + row] * modelView[col * 4 + k];
+			}
+			mvp[col * 4 + row] = sum;
+		}
+	}
+}
+
+uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	float magnitude = fabsf(value);
+
+	if (!(magnitude < 65504.0f)) return sign | 0x7BFF;
+	if (magnitude < 6.103515625e-05f) {
+		// subnormal, steps of 2^-24
+		return sign | (uint16_t)lrintf(magnitude * 16777216.0f);
+	}
+
+	// rebias the exponent from 127 to 15 and round the mantissa from 23 to 10 bits
+	uint32_t rebiased = (bits & 0x7FFFFFFF) - (112u << 23);
+	return sign | (uint16_t)((rebiased + 0x1000) >> 13);
+}
+
+void VertexBatch::begin(GLenum primitiveType) {
+	primitive = primitiveType;
+	pending.clear();
+
+	switch (primitive) {
+	case GL_POINTS:
+		drawMode = GL_POINTS;
+		break;
+	case GL_LINES:
+	case GL_LINE_STRIP:
+	case GL_LINE_LOOP:
+		drawMode = GL_LINES;
+		break;
+	default:
+		drawMode = GL_TRIANGLES;
+		break;
+	}
+}
+
+void VertexBatch::color(float r, float g, float b, float a) {
+	current.r = r;
+	current.g = g;
+	current.b = b;
+	current.a = a;
+}
+
+void VertexBatch::vertex(float x, float y, float z) {
+	current.x = x;
+	current.y = y;
+	current.z = z;
+
+	if (primitive == GL_POINTS || primitive == GL_LINES || primitive == GL_TRIANGLES) {
+		vertices.push_back(current);
+		return;
+	}
+
+	pending.push_back(current);
+	size_t n = pending.size() - 1;
+
+	switch (primitive) {
+	case GL_QUADS:
+		if (n == 3) {
+			vertices.insert(vertices.end(), { pending[0], pending[1], pending[2], pending[0], pending[2], pending[3] });
+			pending.clear();
+		}
+		break;
+	case GL_QUAD_STRIP:
+		if (n >= 3 && (n & 1)) {
+			vertices.insert(vertices.end(), { pending[n - 3], pending[n - 2], pending[n],
+				pending[n - 3], pending[n], pending[n - 1] });
+		}
+		break;
+	case GL_TRIANGLE_STRIP:
+		if (n >= 2) vertices.insert(vertices.end(), { pending[n - 2], pending[n - 1], pending[n] });
+		break;
+	case GL_TRIANGLE_FAN:
+		if (n >= 2) vertices.insert(vertices.end(), { pending[0], pending[n - 1], pending[n] });
+		break;
+	case GL_LINE_STRIP:
+	case GL_LINE_LOOP:
+		if (n >= 1) vertices.insert(vertices.end(), { pending[n - 1], pending[n] });
+		break;
+	}
+}
+
+void VertexBatch::end() {
+	if (primitive == GL_LINE_LOOP && pending.size() >= 2) {
+		vertices.insert(vertices.end(), { pending.back(), pending.front() });
+	}
+	pending.clear();
+}
+
+// batch program with the uniforms for the current viewport, point size and smoothing
+static void useBatchProgram(const float mvp[16], GLenum drawMode) {
+	bool roundPoints = drawMode == GL_POINTS && glIsEnabled(GL_POINT_SMOOTH);
+
+	GLint viewport[4];
+	GLfloat pointSize;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_POINT_SIZE, &pointSize);
+
+	glUseProgram(batchProgram);
+	glUniformMatrix4fv(batchMvpLocation, 1, GL_FALSE, mvp);
+	glUniform1i(batchRoundPointsLocation, roundPoints ? 1 : 0);
+	glUniform4f(batchViewportLocation, (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+	glUniform1f(batchPointSizeLocation, pointSize);
+}
+
+static void streamAndDraw(GLuint vao, GLuint vbo, const void* data, size_t bytes, GLenum drawMode, size_t count) {
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW);
+	glDrawArrays(drawMode, 0, (GLsizei)count);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	glDisable(GL_PROGRAM_POINT_SIZE);
+
+	glUseProgram(0);
+}
+
+void VertexBatch::draw() {
+	if (vertices.empty()) return;
+
+	if (g_renderBackend == RenderBackend::MODERN) {
+		float mvp[16];
+		getModelViewProjection(mvp);
+
+		useBatchProgram(mvp, drawMode);
+		streamAndDraw(batchVao, batchVbo, vertices.data(), vertices.size() * sizeof(BatchVertex), drawMode, vertices.size());
+	}
+	else {
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+		glVertexPointer(3, GL_FLOAT, sizeof(BatchVertex), &vertices[0].x);
+		glColorPointer(4, GL_FLOAT, sizeof(BatchVertex), &vertices[0].r);
+		glDrawArrays(drawMode, 0, (GLsizei)vertices.size());
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_COLOR_ARRAY);
+	}
+
+	clear();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "GLFunctions.h"
+#include <vector>
+#include <cstdint>
+
+// MODERN draws from VBOs with GLSL 330 programs, LEGACY is the fixed-function path
+// for drivers without OpenGL 3.3. Both render the same image.
+enum class RenderBackend {
+	LEGACY,
+	MODERN
+};
+
+extern RenderBackend g_renderBackend;
+
+// progressive refinement: 0 while the camera moves, then one step more for every frame
+// it holds still, up to RENDER_REFINEMENT_STEPS. step 1 is the usual quality, 0 a cheaper
+// LOD to keep interaction smooth, the steps above add detail a still shot can afford and
+// are only taken while the simulation is paused (a running one stays at step 1)
+const int RENDER_REFINEMENT_STEPS = 3;
+extern int g_renderRefinement;
+
+// loads the GL entry points and picks the backend, call once the context is current
+void initRenderer();
+
+// compiles and links, attribute locations are bound in order from attributeNames
+// returns 0 (and logs) on failure
+GLuint createShaderProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+	const std::vector<const char*>& attributeNames);
+
+// projection * modelview of the fixed-function matrix stacks, column-major
+void getModelViewProjection(float mvp[16]);
+
+struct BatchVertex {
+	float x, y, z;
+	float r, g, b, a;
+};
+
+// round to nearest, out of range values clamp to the largest half
+uint16_t floatToHalf(float value);
+
+// glBegin/glEnd style geometry collected on the CPU and drawn in one call
+// quads, strips, fans and loops are expanded into triangles / lines as they come in,
+// so one batch can hold any number of primitives of the same kind
+struct VertexBatch {
+	std::vector<BatchVertex> vertices;
+
+	void begin(GLenum primitiveType);
+	void color(float r, float g, float b, float a = 1.0f);
+	void vertex(float x, float y, float z);
+	void end();
+
+	// draws with the current matrices, blend state, point size and line width, then clears
+	void draw();
+	void clear() { vertices.clear(); pending.clear(); }
+
+	// GL_POINTS, GL_LINES or GL_TRIANGLES, set by begin()
+	GLenum drawMode = GL_TRIANGLES;
+
+private:
+	GLenum primitive = GL_TRIANGLES;
+	BatchVertex current = { 0, 0, 0, 1, 1, 1, 1 };
+	std::vector<BatchVertex> pending;
+};
@@ -1,7 +1,9 @@
 #include "SolarSystem.h"
 #include "UI.h"
-#include <GLFW/glfw3.h>
+#include "Renderer.h"
+#include "Camera.h"
 #include <cmath>
+#include <cstddef>
 #include <iostream>
 #include <random>
 
@@ -19,15 +21,15 @@ SolarSystem solarSystem = {0.0, 0.0, 0.0, false};
 Sun sun = {0.0, 0.0, 0.0, 2.0};
 std::vector<Planet> planets;
 
+const int SPHERE_SEGMENTS = 16;
+const int ORBIT_SEGMENTS = 64;
+
 RenderZone calculateRenderZone(const Camera &camera)
 {
     RenderZone zone;
     zone.zoomLevel = camera.zoomLevel;
     zone.distanceFromSystem = 0.0;
 
-    const double GALAXY_ZOOM_MAX = 0.1;
-    const double SYSTEM_ZOOM_MIN = 100.0;
-
     if (camera.zoomLevel < GALAXY_ZOOM_MAX)
     {
         zone.solarSystemScaleMultiplier = 1.0;
@@ -81,12 +83,13 @@ void generateSolarSystem()
         planet.r = PLANET_DATA[i].r;
         planet.g = PLANET_DATA[i].g;
         planet.b = PLANET_DATA[i].b;
-        planet.angle = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double angle = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        planet.phase = phaseFromRadians(angle);
         planet.orbitalSpeed = 0.0005 / sqrt(planet.orbitRadius);
 
-        planet.x = sun.x + planet.orbitRadius * cos(planet.angle);
+        planet.x = sun.x + planet.orbitRadius * cos(angle);
         planet.y = sun.y;
-        planet.z = sun.z + planet.orbitRadius * sin(planet.angle);
+        planet.z = sun.z + planet.orbitRadius * sin(angle);
 
         planets.push_back(planet);
     }
@@ -99,25 +102,54 @@ void updatePlanets(double deltaTime)
 {
     for (auto &planet : planets)
     {
-        planet.angle += planet.orbitalSpeed * deltaTime;
-        while (planet.angle > 2.0 * M_PI)
-            planet.angle -= 2.0 * M_PI;
-        while (planet.angle < 0.0)
-            planet.angle += 2.0 * M_PI;
-
-        planet.x = sun.x + planet.orbitRadius * cos(planet.angle);
-        planet.z = sun.z + planet.orbitRadius * sin(planet.angle);
+        planet.phase += phaseStep(planet.orbitalSpeed, deltaTime);
+
+        // planets are looked at up to 10000x zoom, so they keep double precision trig
+        double angle = phaseToRadians(planet.phase);
+        planet.x = sun.x + planet.orbitRadius * cos(angle);
+        planet.z = sun.z + planet.orbitRadius * sin(angle);
     }
 }
 
-void drawSphere(float radius, int segments)
+// how big the bodies are drawn, in world units, so they stay visible at every zoom
+static float sunRadiusAt(double zoomLevel)
+{
+    if (zoomLevel > 1000.0)
+        return 0.05f;
+    else if (zoomLevel > 500.0)
+        return 0.04f;
+    else if (zoomLevel > 100.0)
+        return 0.03f;
+    else if (zoomLevel > 10.0)
+        return 0.02f;
+    else if (zoomLevel > 1.0)
+        return 0.015f;
+    return 0.01f;
+}
+
+static float planetRadiusAt(double zoomLevel)
+{
+    if (zoomLevel > 500.0)
+        return 0.003f;
+    else if (zoomLevel > 100.0)
+        return 0.0025f;
+    return 0.002f;
+}
+
+static bool orbitVisible(const Planet &planet)
+{
+    return g_cameraView.frustum.boxVisible(sun.x - planet.orbitRadius, sun.y, sun.z - planet.orbitRadius,
+                                           sun.x + planet.orbitRadius, sun.y, sun.z + planet.orbitRadius);
+}
+
+void drawSphere(VertexBatch &batch, float radius, int segments)
 {
     for (int lat = 0; lat < segments; lat++)
     {
         float theta1 = lat * M_PI / segments;
         float theta2 = (lat + 1) * M_PI / segments;
 
-        glBegin(GL_QUAD_STRIP);
+        batch.begin(GL_QUAD_STRIP);
         for (int lon = 0; lon <= segments; lon++)
         {
             float phi = lon * 2 * M_PI / segments;
@@ -130,81 +162,274 @@ void drawSphere(float radius, int segments)
             float y2 = radius * cos(theta2);
             float z2 = radius * sin(theta2) * sin(phi);
 
-            glVertex3f(x1, y1, z1);
-            glVertex3f(x2, y2, z2);
+            batch.vertex(x1, y1, z1);
+            batch.vertex(x2, y2, z2);
         }
-        glEnd();
+        batch.end();
     }
 }
 
-void renderSolarSystem(const RenderZone &zone)
+static void renderSolarSystemLegacy(const RenderZone &zone)
 {
+    static VertexBatch bodyBatch;
+    static VertexBatch orbitBatch;
+
     double scale = zone.solarSystemScaleMultiplier;
+    const CameraView &view = g_cameraView;
 
+    // every body is placed relative to the camera, see loadCameraRelative
     glPushMatrix();
-    glTranslated(sun.x, sun.y, sun.z);
-    glScaled(scale, scale, scale);
-
-    float sunRadius = 0.01f;
-    if (zone.zoomLevel > 1000.0)
-        sunRadius = 0.05f;
-    else if (zone.zoomLevel > 500.0)
-        sunRadius = 0.04f;
-    else if (zone.zoomLevel > 100.0)
-        sunRadius = 0.03f;
-    else if (zone.zoomLevel > 10.0)
-        sunRadius = 0.02f;
-    else if (zone.zoomLevel > 1.0)
-        sunRadius = 0.015f;
-
-    glColor3f(1.0f, 1.0f, 0.3f);
-    drawSphere(sunRadius / scale, 16);
+    loadCameraRelative(sun.x, sun.y, sun.z, scale);
+
+    float sunRadius = sunRadiusAt(zone.zoomLevel);
+
+    // radii are divided by the scale below, so they're world sizes here
+    if (g_cameraView.frustum.sphereVisible(sun.x, sun.y, sun.z, sunRadius))
+    {
+        bodyBatch.color(1.0f, 1.0f, 0.3f);
+        drawSphere(bodyBatch, sunRadius / scale, 16);
+        bodyBatch.draw();
+    }
     glPopMatrix();
 
     for (const auto &planet : planets)
     {
         glPushMatrix();
-        glTranslated(sun.x, sun.y, sun.z);
-        glScaled(scale, scale, scale);
-
-        double relX = (planet.x - sun.x) / scale;
-        double relY = (planet.y - sun.y) / scale;
-        double relZ = (planet.z - sun.z) / scale;
-        glTranslated(relX, relY, relZ);
-
-        float planetRadius = 0.002f;
-        if (zone.zoomLevel > 1000.0)
-            planetRadius = 0.003f;
-        else if (zone.zoomLevel > 500.0)
-            planetRadius = 0.003f;
-        else if (zone.zoomLevel > 100.0)
-            planetRadius = 0.0025f;
-        else if (zone.zoomLevel > 50.0)
-            planetRadius = 0.002f;
-        else if (zone.zoomLevel > 10.0)
-            planetRadius = 0.002f;
-
-        glColor3f(planet.r, planet.g, planet.b);
-        drawSphere(planetRadius / scale, 12);
-        glPopMatrix();
+        loadCameraRelative(planet.x, planet.y, planet.z, scale);
+
+        float planetRadius = planetRadiusAt(zone.zoomLevel);
 
-        if (zone.renderOrbits)
+        if (g_cameraView.frustum.sphereVisible(planet.x, planet.y, planet.z, planetRadius))
         {
-            glPushMatrix();
-            glTranslated(sun.x, sun.y, sun.z);
-            glScaled(scale, scale, scale);
+            bodyBatch.color(planet.r, planet.g, planet.b);
+            drawSphere(bodyBatch, planetRadius / scale, 12);
+            bodyBatch.draw();
+        }
+        glPopMatrix();
 
-            glBegin(GL_LINE_LOOP);
-            glColor3f(0.3f, 0.3f, 0.3f);
-            for (int i = 0; i < 64; i++)
+        if (zone.renderOrbits && orbitVisible(planet))
+        {
+            orbitBatch.begin(GL_LINE_LOOP);
+            orbitBatch.color(0.3f, 0.3f, 0.3f);
+            for (int i = 0; i < ORBIT_SEGMENTS; i++)
             {
-                double angle = (i / 64.0) * 2.0 * M_PI;
-                double x = planet.orbitRadius * cos(angle) / scale;
-                double z = planet.orbitRadius * sin(angle) / scale;
-                glVertex3f(x, 0, z);
+                double angle = (i / (double)ORBIT_SEGMENTS) * 2.0 * M_PI;
+                double x = sun.x + planet.orbitRadius * cos(angle) - view.eyeX;
+                double y = sun.y - view.eyeY;
+                double z = sun.z + planet.orbitRadius * sin(angle) - view.eyeZ;
+                orbitBatch.vertex(x, y, z);
             }
-            glEnd();
-            glPopMatrix();
+            orbitBatch.end();
         }
     }
+
+    // orbits pass close to the camera however far the sun is, so their vertices are
+    // rebased to the eye in double and they all go out together
+    glPushMatrix();
+    loadCameraRelative(view.eyeX, view.eyeY, view.eyeZ);
+    orbitBatch.draw();
+    glPopMatrix();
+}
+
+// the modern path keeps one unit sphere and one unit circle on the GPU and draws every
+// body and every orbit as a scaled, placed instance of them
+struct BodyInstance
+{
+    float x, y, z; // centre relative to the eye
+    float radius;
+    float r, g, b;
+};
+
+static GLuint bodyProgram = 0;
+static GLint bodyMvpLocation = -1;
+static GLuint sphereVao = 0;
+static GLuint orbitVao = 0;
+static GLuint unitMeshVbo = 0;
+static GLuint sphereIbo = 0;
+static GLuint sphereInstanceVbo = 0;
+static GLuint orbitInstanceVbo = 0;
+static GLsizei sphereIndexCount = 0;
+static GLint orbitFirstVertex = 0;
+
+static const char *BODY_VERTEX_SHADER = R"(#version 330 core
+in vec3 aPosition;
+in vec4 aInstance;
+in vec3 aColor;
+
+uniform mat4 uMVP;
+
+out vec3 vColor;
+
+void main() {
+	vColor = aColor;
+	gl_Position = uMVP * vec4(aInstance.xyz + aPosition * aInstance.w, 1.0);
+}
+)";
+
+static const char *BODY_FRAGMENT_SHADER = R"(#version 330 core
+in vec3 vColor;
+
+out vec4 fragColor;
+
+void main() {
+	fragColor = vec4(vColor, 1.0);
+}
+)";
+
+// per-instance centre and radius in attribute 1, colour in attribute 2
+static void bindBodyInstances(GLuint instanceVbo)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(BodyInstance), (const void *)offsetof(BodyInstance, x));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(BodyInstance), (const void *)offsetof(BodyInstance, r));
+    glVertexAttribDivisor(2, 1);
+}
+
+static bool initBodyProgram()
+{
+    bodyProgram = createShaderProgram("solar system", BODY_VERTEX_SHADER, BODY_FRAGMENT_SHADER,
+                                      {"aPosition", "aInstance", "aColor"});
+    if (!bodyProgram)
+        return false;
+    bodyMvpLocation = glGetUniformLocation(bodyProgram, "uMVP");
+
+    // the sphere as the legacy path's quad strips, split into triangles, then the orbit circle
+    std::vector<float> vertices;
+    std::vector<GLuint> indices;
+    for (int lat = 0; lat <= SPHERE_SEGMENTS; lat++)
+    {
+        double theta = lat * M_PI / SPHERE_SEGMENTS;
+        for (int lon = 0; lon <= SPHERE_SEGMENTS; lon++)
+        {
+            double phi = lon * 2.0 * M_PI / SPHERE_SEGMENTS;
+            vertices.push_back((float)(sin(theta) * cos(phi)));
+            vertices.push_back((float)cos(theta));
+            vertices.push_back((float)(sin(theta) * sin(phi)));
+        }
+    }
+    const GLuint rowLength = SPHERE_SEGMENTS + 1;
+    for (int lat = 0; lat < SPHERE_SEGMENTS; lat++)
+    {
+        for (int lon = 0; lon < SPHERE_SEGMENTS; lon++)
+        {
+            GLuint top = lat * rowLength + lon;
+            GLuint bottom = top + rowLength;
+            indices.insert(indices.end(), {top, bottom, top + 1, top + 1, bottom, bottom + 1});
+        }
+    }
+    sphereIndexCount = (GLsizei)indices.size();
+
+    orbitFirstVertex = (GLint)(vertices.size() / 3);
+    for (int i = 0; i < ORBIT_SEGMENTS; i++)
+    {
+        double angle = (i / (double)ORBIT_SEGMENTS) * 2.0 * M_PI;
+        vertices.push_back((float)cos(angle));
+        vertices.push_back(0.0f);
+        vertices.push_back((float)sin(angle));
+    }
+
+    glGenBuffers(1, &unitMeshVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, unitMeshVbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &sphereInstanceVbo);
+    glGenBuffers(1, &orbitInstanceVbo);
+
+    glGenVertexArrays(1, &sphereVao);
+    glBindVertexArray(sphereVao);
+    glGenBuffers(1, &sphereIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, unitMeshVbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (const void *)0);
+    bindBodyInstances(sphereInstanceVbo);
+
+    glGenVertexArrays(1, &orbitVao);
+    glBindVertexArray(orbitVao);
+    glBindBuffer(GL_ARRAY_BUFFER, unitMeshVbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (const void *)0);
+    bindBodyInstances(orbitInstanceVbo);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+static void drawBodyInstances(GLuint vao, GLuint instanceVbo, const std::vector<BodyInstance> &instances,
+                              GLenum mode, GLsizei count, bool indexed, GLint first)
+{
+    if (instances.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BodyInstance), instances.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(vao);
+    if (indexed)
+        glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, (const void *)0, (GLsizei)instances.size());
+    else
+        glDrawArraysInstanced(mode, first, count, (GLsizei)instances.size());
+    glBindVertexArray(0);
+}
+
+static void renderSolarSystemModern(const RenderZone &zone)
+{
+    static std::vector<BodyInstance> bodies;
+    static std::vector<BodyInstance> orbits;
+    bodies.clear();
+    orbits.clear();
+
+    // centres are taken relative to the eye in double, like loadCameraRelative, and the
+    // radii are world sizes (the legacy path's scale and 1/scale cancel out)
+    const CameraView &view = g_cameraView;
+    auto instance = [&](double x, double y, double z, double radius, float r, float g, float b)
+    {
+        return BodyInstance{(float)(x - view.eyeX), (float)(y - view.eyeY), (float)(z - view.eyeZ),
+                            (float)radius, r, g, b};
+    };
+
+    float sunRadius = sunRadiusAt(zone.zoomLevel);
+    if (view.frustum.sphereVisible(sun.x, sun.y, sun.z, sunRadius))
+        bodies.push_back(instance(sun.x, sun.y, sun.z, sunRadius, 1.0f, 1.0f, 0.3f));
+
+    float planetRadius = planetRadiusAt(zone.zoomLevel);
+    for (const auto &planet : planets)
+    {
+        if (view.frustum.sphereVisible(planet.x, planet.y, planet.z, planetRadius))
+            bodies.push_back(instance(planet.x, planet.y, planet.z, planetRadius, planet.r, planet.g, planet.b));
+
+        if (zone.renderOrbits && orbitVisible(planet))
+            orbits.push_back(instance(sun.x, sun.y, sun.z, planet.orbitRadius, 0.3f, 0.3f, 0.3f));
+    }
+
+    float mvp[16];
+    glPushMatrix();
+    loadCameraRelative(view.eyeX, view.eyeY, view.eyeZ);
+    getModelViewProjection(mvp);
+    glPopMatrix();
+
+    glUseProgram(bodyProgram);
+    glUniformMatrix4fv(bodyMvpLocation, 1, GL_FALSE, mvp);
+    drawBodyInstances(sphereVao, sphereInstanceVbo, bodies, GL_TRIANGLES, sphereIndexCount, true, 0);
+    drawBodyInstances(orbitVao, orbitInstanceVbo, orbits, GL_LINE_LOOP, ORBIT_SEGMENTS, false, orbitFirstVertex);
+    glUseProgram(0);
+}
+
+void renderSolarSystem(const RenderZone &zone)
+{
+    if (g_renderBackend == RenderBackend::MODERN && !bodyProgram && !initBodyProgram())
+    {
+        std::cout << "Solar system shader unavailable, falling back to the fixed-function renderer" << std::endl;
+        g_renderBackend = RenderBackend::LEGACY;
+    }
+
+    if (g_renderBackend == RenderBackend::MODERN)
+        renderSolarSystemModern(zone);
+    else
+        renderSolarSystemLegacy(zone);
 }
@@ -1,12 +1,16 @@
 #pragma once
 #include <vector>
 #include "Camera.h"
+#include "OrbitalPhase.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 const double GALAXY_TO_SYSTEM_TRANSITION_DIST = 50.0;
+// calculateRenderZone's zones: galaxy zoom below GALAXY_ZOOM_MAX, system zoom from SYSTEM_ZOOM_MIN
+const double GALAXY_ZOOM_MAX = 0.1;
+const double SYSTEM_ZOOM_MIN = 100.0;
 const double SYSTEM_SCALE_MULTIPLIER = 500.0;
 const int NUM_PLANETS = 8;
 
@@ -21,7 +25,7 @@ struct Planet {
     double x, y, z;
     double orbitRadius;
     double radius;
-    double angle;
+    OrbitalPhase phase;
     double orbitalSpeed;
     float r, g, b;
 };
@@ -1,9 +1,14 @@
 ﻿#include "Stars.h"
 #include "SolarSystem.h"
-#include <GLFW/glfw3.h>
+#include "Parallel.h"
+#include "OrbitalPhase.h"
+#include "Renderer.h"
 #include <iostream>
 #include <cmath>
 #include <random>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -25,21 +30,251 @@ const StarType starTypes[] = {
 	{1.0f, 0.6f, 0.5f, 0.10f}    // M - Red (cool, common)
 };
 
-void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config) {
-	std::mt19937 rng(config.seed);
+// distance (along the orbit) from a point to the closest logarithmic spiral arm
+static float nearestArmDistance(float radius, float theta, const GalaxyConfig& config) {
+	float minArmDistance = 1e10f;
+
+	for (int arm = 0; arm < config.numSpiralArms; arm++) {
+		// Logarithmic spiral: r = a * e^(b * theta)
+		// Solving for theta: theta = ln(r/a) / b
+		float armOffset = (arm * 2.0f * M_PI) / config.numSpiralArms;
+
+		// Calculate where this radius intersects the spiral arm
+		float spiralTheta = log(radius / config.bulgeRadius) / config.spiralTightness + armOffset;
+
+		// Normalize angle difference to [-PI, PI]
+		float angleDiff = remainderf(theta - spiralTheta, 2.0f * M_PI);
+
+		// Convert angle difference to distance at this radius
+		float armDistance = fabs(angleDiff * radius);
+		minArmDistance = fmin(minArmDistance, armDistance);
+	}
+
+	return minArmDistance;
+}
+
+// relative disk density at (radius, theta), 0..1
+// radial falloff is handled separately by the exponential profile
+static float diskDensityWeight(float radius, float theta, const GalaxyConfig& config) {
+	float minArmDistance = nearestArmDistance(radius, theta, config);
+
+	float radiusNorm = radius / static_cast<float>(config.diskRadius);
+	float edgeFactor = (radiusNorm > 1.0f) ? 1.0f : radiusNorm; // Clamp for calculation
+	float effectiveArmWidth = config.armWidth * (1.0f + edgeFactor * 1.5f); // Arms get wider towards edges
+
+	// Stars close to arms have high probability, far from arms very low
+	float armProximity = exp(-minArmDistance * minArmDistance / (effectiveArmWidth * effectiveArmWidth));
+
+	float weight;
+	if (radius > config.diskRadius) {
+		// we over the disk radius, this is the outlier region
+		// split into multiple zones for smoother transition
+		float excessRadius = radius - config.diskRadius;
+		float fadeScale = config.diskRadius * 0.15f;
+
+		float outlierFactor = exp(-excessRadius / fadeScale);
+
+		// quadratic suppression for extreme outliers
+		if (radiusNorm > 1.3f) {
+			float extremeFactor = 1.3f / radiusNorm;
+			outlierFactor *= extremeFactor * extremeFactor;
+		}
+
+		// 8% of normal density
+		weight = outlierFactor * 0.08f;
+	}
+	else {
+		float densityWeight = armProximity * config.armDensityBoost;
+		weight = (1.0f + densityWeight) / (1.0f + config.armDensityBoost);
+
+		// inter-arm regions are 5x sparser
+		if (armProximity < 0.3f) {
+			weight *= 0.2f;
+		}
+
+		if (radius > config.diskRadius * 0.85f) {
+			// Transition zone (85% - 100% of diskRadius) with gradual fadeout
+			float transitionFactor = (config.diskRadius - radius) / (config.diskRadius * 0.15f);
+			weight *= 0.5f + 0.5f * transitionFactor;
+		}
+	}
+
+	return weight;
+}
+
+// Exponential disk radial profile
+// Radial surface density: Sigma(r) ∝ exp(-r/rd)
+// Radial PDF (per radius) ∝ r * exp(-r/rd)
+// CDF: F(r) = 1 - (1 + r/rd) * exp(-r/rd)
+static double exponentialDiskCdf(double r, double diskScale) {
+	double t = r / diskScale;
+	return 1.0 - (1.0 + t) * exp(-t);
+}
+
+// 2D inverse-CDF table over (radius, angle from the nearest arm) holding the full
+// disk density: exponential profile * arm proximity * edge fade
+// the arm pattern repeats every 2*PI/numArms, so one period is tabulated and a random
+// arm is picked at sample time. every draw produces a star, no rejection
+struct DiskSampler {
+	static const int RADIAL_BINS = 1024;
+	static const int ANGLE_BINS = 256;
+
+	float maxRadius;
+	float radialBinSize;
+	float armPeriod;
+	int numArms;
+	float meanDensity;	// density weight averaged over the radial profile
+	float bulgeRadius;
+	float spiralTightness;
+
+	std::vector<float> radialCdf;	// RADIAL_BINS entries, last one is 1
+	std::vector<float> angleCdf;	// ANGLE_BINS entries per radial bin
+
+	void build(const GalaxyConfig& config) {
+		double diskScale = config.diskRadius * 0.25; // tune to taste
+		maxRadius = static_cast<float>(config.diskRadius) * 2.0f; // allow 2x radius to allow stars beyond diskRadius to fade out (not creating an uniform circle)
+		radialBinSize = maxRadius / RADIAL_BINS;
+		numArms = config.numSpiralArms > 0 ? config.numSpiralArms : 1;
+		armPeriod = 2.0f * M_PI / numArms;
+		bulgeRadius = static_cast<float>(config.bulgeRadius);
+		spiralTightness = static_cast<float>(config.spiralTightness);
+
+		radialCdf.assign(RADIAL_BINS, 0.0f);
+		angleCdf.assign(RADIAL_BINS * ANGLE_BINS, 0.0f);
+
+		std::vector<double> radialMass(RADIAL_BINS);
+
+		parallelFor(RADIAL_BINS, [&](int i) {
+			float radius = (i + 0.5f) * radialBinSize;
+			float spiralTheta = log(radius / config.bulgeRadius) / config.spiralTightness;
+
+			float* cdf = &angleCdf[i * ANGLE_BINS];
+			double sum = 0.0;
+			for (int j = 0; j < ANGLE_BINS; j++) {
+				float theta = spiralTheta + (j + 0.5f) * armPeriod / ANGLE_BINS;
+				sum += diskDensityWeight(radius, theta, config);
+				cdf[j] = static_cast<float>(sum);
+			}
+			for (int j = 0; j < ANGLE_BINS; j++) {
+				cdf[j] = sum > 0.0 ? static_cast<float>(cdf[j] / sum) : (j + 1.0f) / ANGLE_BINS;
+			}
+
+			// the profile is clamped at maxRadius, so its tail lands in the last bin
+			double r0 = i * (double)radialBinSize;
+			double r1 = (i == RADIAL_BINS - 1) ? 1e30 : (i + 1) * (double)radialBinSize;
+			double profileMass = exponentialDiskCdf(r1, diskScale) - exponentialDiskCdf(r0, diskScale);
+			radialMass[i] = profileMass * sum / ANGLE_BINS;
+		});
+
+		double total = 0.0;
+		for (int i = 0; i < RADIAL_BINS; i++) {
+			total += radialMass[i];
+			radialCdf[i] = static_cast<float>(total);
+		}
+		meanDensity = static_cast<float>(total);
+		for (int i = 0; i < RADIAL_BINS; i++) {
+			radialCdf[i] = static_cast<float>(radialCdf[i] / total);
+		}
+		radialCdf[RADIAL_BINS - 1] = 1.0f;
+	}
+
+	void sample(std::mt19937& rng, float& radius, float& theta) const {
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+		int radialBin = (int)(std::upper_bound(radialCdf.begin(), radialCdf.end(), dist(rng)) - radialCdf.begin());
+		radialBin = std::min(radialBin, RADIAL_BINS - 1);
+		radius = (radialBin + dist(rng)) * radialBinSize;
+
+		const float* cdf = &angleCdf[radialBin * ANGLE_BINS];
+		int angleBin = (int)(std::upper_bound(cdf, cdf + ANGLE_BINS, dist(rng)) - cdf);
+		angleBin = std::min(angleBin, ANGLE_BINS - 1);
+		float armOffset = (angleBin + dist(rng)) * armPeriod / ANGLE_BINS;
+
+		int arm = std::min((int)(dist(rng) * numArms), numArms - 1);
+
+		// place the star relative to its arm at the exact radius so arms stay smooth curves
+		float spiralTheta = log(radius / bulgeRadius) / spiralTightness;
+		theta = fmodf(spiralTheta + armOffset + arm * armPeriod, 2.0f * M_PI);
+		if (theta < 0.0f) theta += 2.0f * M_PI;
+	}
+};
+
+static void starColor(const StarField& stars, size_t i, float& r, float& g, float& b) {
+	const StarType& type = starTypes[stars.type[i]];
+	float brightness = stars.brightnessAt(i);
+	r = type.r * brightness;
+	g = type.g * brightness;
+	b = type.b * brightness;
+}
+
+void StarField::resize(size_t count) {
+	radius.resize(count);
+	phase.resize(count);
+	flags.resize(count);
+	y.resize(count);
+	type.resize(count);
+	brightness.resize(count);
+}
+
+void StarField::set(size_t i, const Star& star) {
+	radius[i] = star.radius;
+	phase[i] = phaseFromRadians(star.angle);
+	flags[i] = star.inBulge ? STAR_FLAG_BULGE : 0;
+	y[i] = star.y;
+	type[i] = star.type;
+	brightness[i] = static_cast<uint8_t>(lrintf(std::min(std::max(star.brightness, 0.0f), 1.0f) * 255.0f));
+}
+
+Star StarField::get(size_t i) const {
+	Star star;
+	float s, c;
+	phaseSinCos(phase[i], s, c);
+	star.x = radius[i] * c;
+	star.y = y[i];
+	star.z = radius[i] * s;
+	star.type = type[i];
+	star.brightness = brightnessAt(i);
+	star.inBulge = (flags[i] & STAR_FLAG_BULGE) != 0;
+	star.radius = radius[i];
+	star.angle = static_cast<float>(phaseToRadians(phase[i]));
+	star.angularVelocity = angularVelocity(i);
+	return star;
+}
+
+// stars are generated in fixed-size chunks, each with its own rng stream derived
+// from (seed, chunk index), so the galaxy doesn't depend on how many threads ran
+const int STAR_CHUNK_SIZE = 16384;
+
+// ring 0 is the bulge (it already rotates as one), disk rings split [0, 2 * diskRadius]
+static int numStarRings(const GalaxyConfig& config) {
+	return config.numRotationRings > 0 ? std::min(config.numRotationRings, 65534) + 1 : 0;
+}
+
+static float diskRingWidth(const GalaxyConfig& config) {
+	return static_cast<float>(config.diskRadius) * 2.0f / (numStarRings(config) - 1);
+}
+
+static void generateStarChunk(StarField& stars, std::vector<uint16_t>& ringIds, int first, int count, int chunkIndex,
+	const GalaxyConfig& config, const DiskSampler& diskSampler) {
+	const int numRings = numStarRings(config);
+
+	std::seed_seq chunkSeed{ config.seed, static_cast<unsigned int>(chunkIndex) };
+	std::mt19937 rng(chunkSeed);
 	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
 	std::normal_distribution<float> normalDist(0.0f, 1.0f);
 
-	stars.clear();
-	stars.reserve(config.numStars);
+	// 15% of the raw candidates are bulge stars, but the disk density only keeps
+	// meanDensity of its candidates, so the bulge ends up with a larger share
+	float bulgeFraction = 0.15f / (0.15f + 0.85f * diskSampler.meanDensity);
 
-	for (int i = 0; i < config.numStars; i++) {
+	for (int i = 0; i < count; i++) {
 		Star star;
 
 		// Decide if star is in bulge or disk
 		// bulge = the spherical central region
 		// disk = the flat rotating part with spiral arms
-		bool inBulge = dist(rng) < 0.15f; // 15%
+		bool inBulge = dist(rng) < bulgeFraction;
+		star.inBulge = inBulge;
 
 		if (inBulge) {
 			// spherical distribution
@@ -56,125 +291,15 @@ void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config) {
 			star.angle = atan2(star.z, star.x);
 
 			// higher velocity since bulge rotates faster
-			star.angularVelocity = config.rotationSpeed * 0.5f / (config.bulgeRadius + 1.0f);
+			star.angularVelocity = stars.angularVelocity(star.radius, true);
 		}
 		else {
-			// disk & arms
-
-			// Exponential disk sampling
-			// Radial surface density: Sigma(r) ∝ exp(-r/rd)
-			// Radial PDF (per radius) ∝ r * exp(-r/rd)
-			// CDF: F(r) = 1 - (1 + r/rd) * exp(-r/rd)
-			// Invert F numerically (Newton) to get r for uniform u in [0,1].
-			auto sampleExponentialDiskRadius = [&](float diskScale) -> float {
-				float u = dist(rng);
-				// initial guess: exponential inverse (not exact for r*e^{-r/rd} but a reasonable start)
-				float r = -diskScale * std::log(1.0f - u + 1e-8f);
-				// Newton iteration to solve F(r) - u = 0
-				for (int it = 0; it < 10; ++it) {
-					float t = r / diskScale;
-					float expNegT = std::exp(-t);
-					float F = 1.0f - (1.0f + t) * expNegT;        // F(r)
-					float G = F - u;							  // want G == 0
-
-					if (std::fabs(G) < 1e-6f) break;
-					// dF/dr = (r / rd^2) * exp(-r/rd)
-					float dFdr = (r == 0.0f) ? (1.0f / (diskScale)) * 0.0f : (r / (diskScale * diskScale)) * expNegT;
-					// fallback if derivative is too small
-					if (dFdr <= 1e-12f) break;
-					float delta = G / dFdr;
-					r -= delta;
-					if (r < 0.0f) { r = 0.0f; break; }
-				}
-				return r;
-				};
-
-			float diskScale = static_cast<float>(config.diskRadius) * 0.25f; // tune to taste
-			float radius = sampleExponentialDiskRadius(diskScale);
-
-			float maxRadius = static_cast<float>(config.diskRadius) * 2.0f; // allow 2x radius to allow stars beyond diskRadius to fade out (not creating an uniform circle)
-			if (radius > maxRadius) {
-				radius = maxRadius;
-			}
-
-			// Base angle
-			float theta = dist(rng) * 2.0f * M_PI;
-
-			// Calculate distance to nearest spiral arm
-			float minArmDistance = 1e10f;
-
-			for (int arm = 0; arm < config.numSpiralArms; arm++) {
-				// Logarithmic spiral: r = a * e^(b * theta)
-				// Solving for theta: theta = ln(r/a) / b
-				float armOffset = (arm * 2.0f * M_PI) / config.numSpiralArms;
-
-				// Calculate where this radius intersects the spiral arm
-				float spiralTheta = log(radius / config.bulgeRadius) / config.spiralTightness + armOffset;
-
-				// Normalize angle difference to [-PI, PI]
-				float angleDiff = theta - spiralTheta;
-				while (angleDiff > M_PI) angleDiff -= 2.0f * M_PI;
-				while (angleDiff < -M_PI) angleDiff += 2.0f * M_PI;
-
-				// Convert angle difference to distance at this radius
-				float armDistance = fabs(angleDiff * radius);
-				minArmDistance = fmin(minArmDistance, armDistance);
-			}
+			// disk & arms, drawn straight from the precomputed density table
+			float radius, theta;
+			diskSampler.sample(rng, radius, theta);
 
 			float radiusNorm = radius / static_cast<float>(config.diskRadius);
 			float edgeFactor = (radiusNorm > 1.0f) ? 1.0f : radiusNorm; // Clamp for calculation
-			float effectiveArmWidth = config.armWidth * (1.0f + edgeFactor * 1.5f); // Arms get wider towards edges
-
-			// Stars close to arms have high probability, far from arms very low
-			float armProximity = exp(-minArmDistance * minArmDistance / (effectiveArmWidth * effectiveArmWidth));
-
-			float acceptProbability;
-			if (radius > config.diskRadius) {
-				// we over the disk radius, this is the outlier region
-				// split into multiple zones for smoother transition
-				float excessRadius = radius - config.diskRadius;
-				float fadeScale = config.diskRadius * 0.15f;
-				
-				float outlierFactor = exp(-excessRadius / fadeScale);
-				
-				// quadratic suppression for extreme outliers
-				if (radiusNorm > 1.3f) {
-					float extremeFactor = 1.3f / radiusNorm;
-					outlierFactor *= extremeFactor * extremeFactor;
-				}
-				
-				// 8% of normal density
-				acceptProbability = outlierFactor * 0.08f;
-			}
-			else if (radius > config.diskRadius * 0.85f) {
-				// Transition zone (85% - 100% of diskRadius) with gradual fadeout
-				float transitionFactor = (config.diskRadius - radius) / (config.diskRadius * 0.15f);
-				transitionFactor = 0.5f + 0.5f * transitionFactor;
-				
-				float densityWeight = armProximity * config.armDensityBoost;
-				acceptProbability = (1.0f + densityWeight) / (1.0f + config.armDensityBoost);
-
-				// 80% rejection for inter-arm regions
-				if (armProximity < 0.3f) {
-					acceptProbability *= 0.2f;
-				}
-				
-				acceptProbability *= transitionFactor;
-			}
-			else {
-				float densityWeight = armProximity * config.armDensityBoost;
-				acceptProbability = (1.0f + densityWeight) / (1.0f + config.armDensityBoost);
-
-				// 80% rejection for inter-arm regions
-				if (armProximity < 0.3f) {
-					acceptProbability *= 0.2f;
-				}
-			}
-
-			if (dist(rng) > acceptProbability) {
-				i--;  // Retry this star
-				continue;
-			}
 
 			// positional noise for irregular edges
 			float noiseScale = 15.0f * (1.0f + radiusNorm * 0.8f);
@@ -194,7 +319,7 @@ void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config) {
 			star.radius = radius;
 			star.angle = theta;
 			// outer stars rotate slower
-			star.angularVelocity = config.rotationSpeed * 1.0f / (sqrt(radius / config.bulgeRadius) * (radius + 1.0f));
+			star.angularVelocity = stars.angularVelocity(radius, false);
 		}
 
 		// select star type
@@ -202,7 +327,7 @@ void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config) {
 		float cumulative = 0.0f;
 		int selectedType = 6; // default M type
 
-		for (int t = 0; t < 7; t++) {
+		for (int t = 0; t < NUM_STAR_TYPES; t++) {
 			cumulative += starTypes[t].probability;
 			if (typeRoll <= cumulative) {
 				selectedType = t;
@@ -210,9 +335,7 @@ void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config) {
 			}
 		}
 
-		star.r = starTypes[selectedType].r;
-		star.g = starTypes[selectedType].g;
-		star.b = starTypes[selectedType].b;
+		star.type = static_cast<uint8_t>(selectedType);
 
 		// stars in bulge tend to be older
 		float distFromCenter = sqrt(star.x * star.x + star.y * star.y + star.z * star.z);
@@ -223,55 +346,707 @@ void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config) {
 			star.brightness = 0.3f + dist(rng) * 0.7f; // bright
 
 			// stars in spiral arms are brighter
-			float minArmDist = 1e10f;
+			float minArmDist = nearestArmDistance(star.radius, star.angle, config);
+			float armBrightness = exp(-minArmDist * minArmDist / (config.armWidth * config.armWidth * 4.0f));
+
+			star.brightness += armBrightness * 0.3f;
+			if (star.brightness > 1.0f) star.brightness = 1.0f;
+		}
 
-			for (int arm = 0; arm < config.numSpiralArms; arm++) {
-				float armOffset = (arm * 2.0f * M_PI) / config.numSpiralArms;
-				float spiralTheta = log(star.radius / config.bulgeRadius) / config.spiralTightness + armOffset;
-				float angleDiff = star.angle - spiralTheta;
+		stars.set(first + i, star);
 
-				while (angleDiff > M_PI) angleDiff -= 2.0f * M_PI;
-				while (angleDiff < -M_PI) angleDiff += 2.0f * M_PI;
+		if (numRings > 0) {
+			int ring = inBulge ? 0 : 1 + std::min((int)(star.radius / diskRingWidth(config)), numRings - 2);
+			ringIds[first + i] = static_cast<uint16_t>(ring);
+		}
+	}
+}
 
-				float armDist = fabs(angleDiff * star.radius);
+template <typename T>
+static void permuteColumn(AlignedVector<T>& column, const std::vector<uint32_t>& order) {
+	AlignedVector<T> sorted(column.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		sorted[i] = column[order[i]];
+	}
+	column.swap(sorted);
+}
 
-				minArmDist = fmin(minArmDist, armDist);
-			}
-			float armBrightness = exp(-minArmDist * minArmDist / (config.armWidth * config.armWidth * 4.0f));
+// brightest first (by cell, if there are cells), so any prefix of a cell is the best
+// looking subset of that size for the LOD to draw. ties keep generation order, which
+// is random, so a prefix is also an even spatial sample
+static void sortStars(StarField& stars, const std::vector<uint32_t>& cellIds, size_t numCells) {
+	const size_t count = stars.size();
 
-			star.brightness += armBrightness * 0.3f;
-			if (star.brightness > 1.0f) star.brightness = 1.0f;
+	// counting sort on the brightness byte, then a stable one on the cell
+	std::vector<size_t> start(257, 0);
+	for (size_t i = 0; i < count; i++) {
+		start[256 - stars.brightness[i]]++;
+	}
+	for (int key = 1; key < 257; key++) {
+		start[key] += start[key - 1];
+	}
+	std::vector<uint32_t> byBrightness(count);
+	for (size_t i = 0; i < count; i++) {
+		byBrightness[start[255 - stars.brightness[i]]++] = static_cast<uint32_t>(i);
+	}
+
+	std::vector<uint32_t> order;
+	if (numCells == 0) {
+		order.swap(byBrightness);
+	}
+	else {
+		std::vector<size_t> next(numCells + 1, 0);
+		for (uint32_t cell : cellIds) {
+			next[cell + 1]++;
+		}
+		for (size_t cell = 1; cell <= numCells; cell++) {
+			next[cell] += next[cell - 1];
 		}
+		order.resize(count);
+		for (uint32_t i : byBrightness) {
+			order[next[cellIds[i]]++] = i;
+		}
+	}
+
+	permuteColumn(stars.radius, order);
+	permuteColumn(stars.phase, order);
+	permuteColumn(stars.flags, order);
+	permuteColumn(stars.y, order);
+	permuteColumn(stars.type, order);
+	permuteColumn(stars.brightness, order);
+}
+
+static int starSector(OrbitalPhase phase) {
+	return (int)(((uint64_t)phase * STAR_RING_SECTORS) >> 32);
+}
+
+// ring * STAR_CELLS_PER_RING + sector * STAR_HEIGHT_SLABS + slab for every star
+static void assignStarCells(const StarField& stars, const std::vector<uint16_t>& ringIds, std::vector<uint32_t>& cellIds) {
+	const size_t count = stars.size();
+	const size_t numRings = stars.rings.size();
+
+	// heights grouped by ring for the quartiles
+	std::vector<float> heights(count);
+	std::vector<size_t> next(numRings);
+	for (size_t ring = 0; ring < numRings; ring++) {
+		next[ring] = stars.rings[ring].first;
+	}
+	for (size_t i = 0; i < count; i++) {
+		heights[next[ringIds[i]]++] = stars.y[i];
+	}
+
+	std::vector<float> slabEdges(numRings * (STAR_HEIGHT_SLABS - 1), 0.0f);
+	for (size_t ring = 0; ring < numRings; ring++) {
+		const StarRing& r = stars.rings[ring];
+		if (r.count == 0) continue;
+
+		float* ringHeights = heights.data() + r.first;
+		float* searchFrom = ringHeights;
+		for (int edge = 0; edge < STAR_HEIGHT_SLABS - 1; edge++) {
+			float* nth = ringHeights + r.count * (edge + 1) / STAR_HEIGHT_SLABS;
+			std::nth_element(searchFrom, nth, ringHeights + r.count);
+			slabEdges[ring * (STAR_HEIGHT_SLABS - 1) + edge] = *nth;
+			searchFrom = nth;
+		}
+	}
+
+	cellIds.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		const float* edges = &slabEdges[ringIds[i] * (STAR_HEIGHT_SLABS - 1)];
+		int slab = (int)(std::upper_bound(edges, edges + STAR_HEIGHT_SLABS - 1, stars.y[i]) - edges);
+		cellIds[i] = ringIds[i] * STAR_CELLS_PER_RING + starSector(stars.phase[i]) * STAR_HEIGHT_SLABS + slab;
+	}
+}
 
-		stars.push_back(star);
+// cell ranges and bounds, and the radial extent of every ring, once the stars are sorted
+static void buildStarCells(StarField& stars, const std::vector<uint32_t>& cellIds) {
+	stars.cells.assign(stars.rings.size() * STAR_CELLS_PER_RING, StarCell{ 0, 0, 0.0f, 0.0f });
+	for (uint32_t cell : cellIds) {
+		stars.cells[cell].count++;
+	}
+
+	uint32_t first = 0;
+	for (StarCell& cell : stars.cells) {
+		cell.first = first;
+		first += cell.count;
+	}
+
+	for (StarCell& cell : stars.cells) {
+		if (cell.count == 0) continue;
+		cell.minY = cell.maxY = stars.y[cell.first];
+		for (uint32_t i = cell.first; i < cell.first + cell.count; i++) {
+			cell.minY = std::min(cell.minY, stars.y[i]);
+			cell.maxY = std::max(cell.maxY, stars.y[i]);
+		}
+	}
+
+	for (StarRing& ring : stars.rings) {
+		ring.minRadius = ring.count > 0 ? stars.radius[ring.first] : 0.0f;
+		ring.maxRadius = ring.minRadius;
+		for (size_t i = ring.first; i < ring.first + ring.count; i++) {
+			ring.minRadius = std::min(ring.minRadius, stars.radius[i]);
+			ring.maxRadius = std::max(ring.maxRadius, stars.radius[i]);
+		}
 	}
 }
 
-void updateStarPositions(std::vector<Star>& stars, double deltaTime) {
-	for (auto& star : stars) {
-		star.angle += star.angularVelocity * deltaTime;
+// ring ranges for the sort, every ring turns at the speed of its middle
+static void buildStarRings(StarField& stars, const std::vector<uint16_t>& ringIds, const GalaxyConfig& config) {
+	const int numRings = numStarRings(config);
+	const float ringWidth = diskRingWidth(config);
 
-		// normalize angle to [0, 2*PI]
-		while (star.angle > 2.0f * M_PI) star.angle -= 2.0f * M_PI;
-		while (star.angle < 0.0f) star.angle += 2.0f * M_PI;
+	stars.rings.assign(numRings, StarRing());
+	for (uint16_t ring : ringIds) {
+		stars.rings[ring].count++;
+	}
 
-		// recalc X and Z based on new angle
-		float oldY = star.y;
-		star.x = star.radius * cos(star.angle);
-		star.z = star.radius * sin(star.angle);
-		star.y = oldY;
+	size_t first = 0;
+	for (int ring = 0; ring < numRings; ring++) {
+		StarRing& r = stars.rings[ring];
+		r.first = first;
+		r.phase = 0;
+		r.minRadius = r.maxRadius = 0.0f;
+		if (ring == 0) {
+			r.angularVelocity = stars.angularVelocity(0.0f, true);
+		}
+		else {
+			r.angularVelocity = stars.angularVelocity((ring - 0.5f) * ringWidth, false);
+		}
+		first += r.count;
 	}
 }
 
-void renderStars(const std::vector<Star>& stars, const RenderZone& zone) {
+void generateStarField(StarField& stars, const GalaxyConfig& config, int numThreads) {
+	int numStars = config.numStars > 0 ? config.numStars : 0;
+	stars.resize(numStars);
+	stars.rotationSpeed = static_cast<float>(config.rotationSpeed);
+	stars.bulgeRadius = static_cast<float>(config.bulgeRadius);
+	stars.diskRadius = static_cast<float>(config.diskRadius);
+
+	DiskSampler diskSampler;
+	diskSampler.build(config);
+
+	std::vector<uint16_t> ringIds(numStarRings(config) > 0 ? numStars : 0);
+
+	int numChunks = (numStars + STAR_CHUNK_SIZE - 1) / STAR_CHUNK_SIZE;
+	parallelFor(numChunks, [&](int chunk) {
+		int first = chunk * STAR_CHUNK_SIZE;
+		int count = std::min(STAR_CHUNK_SIZE, numStars - first);
+		generateStarChunk(stars, ringIds, first, count, chunk, config, diskSampler);
+	}, numThreads);
+
+	stars.rings.clear();
+	stars.cells.clear();
+	std::vector<uint32_t> cellIds;
+	if (numStarRings(config) > 0) {
+		buildStarRings(stars, ringIds, config);
+		assignStarCells(stars, ringIds, cellIds);
+	}
+
+	size_t numCells = stars.rings.size() * STAR_CELLS_PER_RING;
+	sortStars(stars, cellIds, numCells);
+	if (numCells > 0) {
+		buildStarCells(stars, cellIds);
+	}
+
+	static unsigned int nextGeneration = 1;
+	stars.generation = nextGeneration++;
+	stars.time = 0.0;
+}
+
+void updateStarPositions(StarField& stars, double deltaTime) {
+	if (!stars.rings.empty()) {
+		for (auto& ring : stars.rings) {
+			ring.phase += phaseStep(ring.angularVelocity, deltaTime);
+		}
+		return;
+	}
+
+	const size_t count = stars.size();
+	const float dtTurns = static_cast<float>(deltaTime / (2.0 * M_PI));
+	const float unitsPerTurn = static_cast<float>(PHASE_UNITS_PER_TURN);
+	const float bulgeAngularVelocity = stars.angularVelocity(0.0f, true);
+
+	const float* radius = stars.radius.data();
+	const uint8_t* flags = stars.flags.data();
+	OrbitalPhase* phase = stars.phase.data();
+
+	// angular velocity isn't stored, it's rebuilt from the radius the same way
+	// StarField::angularVelocity does it (sqrt and divide are exact in SIMD too)
+	// step = fractional part of the turns covered this frame, in phase units
+	// (+-half a turn maps onto the full int32 range, which wraps the same way)
+	size_t i = 0;
+
+#if defined(PHASE_AVX2)
+	const __m256 dtv = _mm256_set1_ps(dtTurns);
+	const __m256 units = _mm256_set1_ps(unitsPerTurn);
+	const __m256 speed = _mm256_set1_ps(stars.rotationSpeed);
+	const __m256 bulgeRadius = _mm256_set1_ps(stars.bulgeRadius);
+	const __m256 bulgeSpeed = _mm256_set1_ps(bulgeAngularVelocity);
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 r = _mm256_load_ps(radius + i);
+		__m256 w = _mm256_div_ps(speed, _mm256_mul_ps(_mm256_sqrt_ps(_mm256_div_ps(r, bulgeRadius)), _mm256_add_ps(r, one)));
+		__m256i bulge = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(flags + i)));
+		w = _mm256_blendv_ps(w, bulgeSpeed, _mm256_castsi256_ps(_mm256_cmpgt_epi32(bulge, _mm256_setzero_si256())));
+
+		__m256 turns = _mm256_mul_ps(w, dtv);
+		turns = _mm256_sub_ps(turns, _mm256_round_ps(turns, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		__m256i step = _mm256_cvtps_epi32(_mm256_mul_ps(turns, units));
+
+		__m256i p = _mm256_add_epi32(_mm256_load_si256((const __m256i*)(phase + i)), step);
+		_mm256_store_si256((__m256i*)(phase + i), p);
+	}
+#elif defined(PHASE_SSE2)
+	const __m128 dtv = _mm_set1_ps(dtTurns);
+	const __m128 units = _mm_set1_ps(unitsPerTurn);
+	const __m128 speed = _mm_set1_ps(stars.rotationSpeed);
+	const __m128 bulgeRadius = _mm_set1_ps(stars.bulgeRadius);
+	const __m128 bulgeSpeed = _mm_set1_ps(bulgeAngularVelocity);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 r = _mm_load_ps(radius + i);
+		__m128 w = _mm_div_ps(speed, _mm_mul_ps(_mm_sqrt_ps(_mm_div_ps(r, bulgeRadius)), _mm_add_ps(r, one)));
+		// four flag bytes, through memcpy since flags + i needn't be int aligned
+		int packedFlags;
+		memcpy(&packedFlags, flags + i, sizeof(packedFlags));
+		__m128i bytes = _mm_cvtsi32_si128(packedFlags);
+		__m128i bulge = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, _mm_setzero_si128()), _mm_setzero_si128());
+		__m128 mask = _mm_castsi128_ps(_mm_cmpgt_epi32(bulge, _mm_setzero_si128()));
+		w = _mm_or_ps(_mm_and_ps(mask, bulgeSpeed), _mm_andnot_ps(mask, w));
+
+		__m128 turns = _mm_mul_ps(w, dtv);
+		turns = _mm_sub_ps(turns, _mm_cvtepi32_ps(_mm_cvtps_epi32(turns)));
+		__m128i step = _mm_cvtps_epi32(_mm_mul_ps(turns, units));
+
+		__m128i p = _mm_add_epi32(_mm_load_si128((const __m128i*)(phase + i)), step);
+		_mm_store_si128((__m128i*)(phase + i), p);
+	}
+#endif
+
+	// scalar tail (and the whole field without SIMD)
+	for (; i < count; i++) {
+		float turns = stars.angularVelocity(i) * dtTurns;
+		turns -= rintf(turns);
+		phase[i] += (OrbitalPhase)(int64_t)llrintf(turns * unitsPerTurn);
+	}
+}
+
+// one display list per ring, compiled once per generation
+static GLuint ringListBase = 0;
+static GLsizei numRingLists = 0;
+static unsigned int ringListsGeneration = 0;
+
+static void buildRingLists(const StarField& stars) {
+	if (numRingLists > 0) {
+		glDeleteLists(ringListBase, numRingLists);
+	}
+
+	numRingLists = (GLsizei)stars.rings.size();
+	ringListBase = glGenLists(numRingLists);
+	ringListsGeneration = stars.generation;
+
+	for (GLsizei ring = 0; ring < numRingLists; ring++) {
+		const StarRing& r = stars.rings[ring];
+
+		glNewList(ringListBase + ring, GL_COMPILE);
+		glBegin(GL_POINTS);
+		for (size_t i = r.first; i < r.first + r.count; i++) {
+			float red, green, blue, s, c;
+			starColor(stars, i, red, green, blue);
+			phaseSinCos(stars.phase[i], s, c);
+			glColor3f(red, green, blue);
+			glVertex3f(stars.radius[i] * c, stars.y[i], stars.radius[i] * s);
+		}
+		glEnd();
+		glEndList();
+	}
+}
+
+// LOD: far out the whole galaxy lands on a few thousand pixels, so only a prefix of every
+// ring (its brightest stars, see sortStars) is drawn, brightened or dimmed so the average
+// covered pixel comes out as bright as with every star drawn
+const float STAR_POINT_PIXELS = 4.0f;		// 2x2 points
+const float STAR_LOD_OVERDRAW = 8.0f;		// stars per covered pixel worth drawing, at refinement 1
+const size_t STAR_LOD_MIN_STARS = 16384;
+const int STAR_LOD_LEVELS = 40;				// light table at fractions 2^(-level/2)
+
+struct StarLod {
+	float fraction = 1.0f;			// of every ring
+	float brightnessScale = 1.0f;
+};
+
+static std::vector<double> lodLight;	// total brightness drawn at each table fraction
+static unsigned int lodLightGeneration = 0;
+
+static size_t lodCount(size_t count, float fraction) {
+	return std::min(count, (size_t)ceil(count * (double)fraction));
+}
+
+static float lodLevelFraction(int level) {
+	return exp2f(-0.5f * level);
+}
+
+// the ranges a prefix is taken from: every cell, or the whole field without rings
+template <typename F>
+static void forEachStarRange(const StarField& stars, F process) {
+	if (stars.cells.empty()) {
+		process((size_t)0, stars.size());
+		return;
+	}
+	for (const StarCell& cell : stars.cells) {
+		if (cell.count > 0) process((size_t)cell.first, (size_t)cell.count);
+	}
+}
+
+static void buildLodLight(const StarField& stars) {
+	lodLight.assign(STAR_LOD_LEVELS, 0.0);
+
+	std::vector<double> cumulative;
+	forEachStarRange(stars, [&](size_t first, size_t count) {
+		cumulative.assign(count + 1, 0.0);
+		for (size_t i = 0; i < count; i++) {
+			cumulative[i + 1] = cumulative[i] + stars.brightness[first + i];
+		}
+		for (int level = 0; level < STAR_LOD_LEVELS; level++) {
+			lodLight[level] += cumulative[lodCount(count, lodLevelFraction(level))];
+		}
+	});
+
+	lodLightGeneration = stars.generation;
+}
+
+static StarLod computeStarLod(const StarField& stars) {
+	StarLod lod;
+	const size_t total = stars.size();
+	if (total <= STAR_LOD_MIN_STARS) return lod;
+
+	// centre behind the eye, we're inside or past the galaxy
+	const double* mvp = g_cameraView.viewProjection;
+	float w = (float)mvp[15];
+	if (w <= 0.0f) return lod;
+
+	if (lodLightGeneration != stars.generation) {
+		buildLodLight(stars);
+	}
+
+	// screen area of the disk from the derivative of the projection at the centre
+	float w2 = w * w;
+	float xx = (float)(mvp[0] * w - mvp[12] * mvp[3]) / w2;
+	float xy = (float)(mvp[1] * w - mvp[13] * mvp[3]) / w2;
+	float zx = (float)(mvp[8] * w - mvp[12] * mvp[11]) / w2;
+	float zy = (float)(mvp[9] * w - mvp[13] * mvp[11]) / w2;
+	float ndcArea = (float)M_PI * stars.diskRadius * stars.diskRadius * fabsf(xx * zy - xy * zx);
+
+	float screenPixels = (float)g_cameraView.width * (float)g_cameraView.height;
+	float pixels = std::min(std::max(ndcArea * screenPixels * 0.25f, 1.0f), screenPixels);
+
+	// how many stars land on a covered pixel with every star drawn
+	// each refinement step draws twice as deep into the dimmer tail of every ring
+	float overdraw = total * STAR_POINT_PIXELS / pixels;
+	float targetOverdraw = STAR_LOD_OVERDRAW * exp2f((float)(g_renderRefinement - 1));
+	lod.fraction = std::min(1.0f, std::max(targetOverdraw / overdraw, (float)STAR_LOD_MIN_STARS / total));
+	if (lod.fraction >= 1.0f) return lod;
+
+	float level = std::min(-2.0f * log2f(lod.fraction), STAR_LOD_LEVELS - 1.001f);
+	int below = (int)level;
+	float t = level - below;
+	double drawnLight = lodLight[below] * (1.0 - t) + lodLight[below + 1] * t;
+
+	// mean brightness of a star, over all stars and over the drawn ones, times the
+	// share of pixels that end up covered (points overwrite each other)
+	double meanAll = lodLight[0] / total;
+	double meanDrawn = drawnLight / (lod.fraction * total);
+	double coverageAll = 1.0 - exp(-overdraw);
+	double coverageDrawn = 1.0 - exp(-overdraw * lod.fraction);
+	lod.brightnessScale = (float)(meanAll * coverageAll / (meanDrawn * coverageDrawn));
+	return lod;
+}
+
+// frustum query on the polar index. a cell is an annular sector, tested through the
+// sphere around it: sector middle at the ring's middle radius, reaching the far corners
+static void findVisibleCells(const StarField& stars, const std::vector<OrbitalPhase>& ringPhases,
+	std::vector<uint32_t>& visible) {
+	const Frustum& frustum = g_cameraView.frustum;
+
+	const float sectorAngle = (float)(2.0 * M_PI / STAR_RING_SECTORS);
+	const float halfSectorCos = cosf(sectorAngle * 0.5f);
+
+	visible.clear();
+	for (size_t ring = 0; ring < stars.rings.size(); ring++) {
+		const StarRing& r = stars.rings[ring];
+		if (r.count == 0) continue;
+
+		float middle = (r.minRadius + r.maxRadius) * 0.5f;
+		float inner = sqrtf(std::max(0.0f, r.minRadius * r.minRadius + middle * middle - 2.0f * r.minRadius * middle * halfSectorCos));
+		float outer = sqrtf(std::max(0.0f, r.maxRadius * r.maxRadius + middle * middle - 2.0f * r.maxRadius * middle * halfSectorCos));
+		float reach = std::max(inner, outer);
+		float ringAngle = (float)phaseToRadians(ringPhases[ring]);
+
+		for (int sector = 0; sector < STAR_RING_SECTORS; sector++) {
+			float angle = (sector + 0.5f) * sectorAngle + ringAngle;
+			float x = middle * cosf(angle);
+			float z = middle * sinf(angle);
+
+			uint32_t firstCell = (uint32_t)(ring * STAR_CELLS_PER_RING + sector * STAR_HEIGHT_SLABS);
+			for (uint32_t cell = firstCell; cell < firstCell + STAR_HEIGHT_SLABS; cell++) {
+				const StarCell& c = stars.cells[cell];
+				if (c.count == 0) continue;
+
+				float halfHeight = (c.maxY - c.minY) * 0.5f;
+				float radius = sqrtf(reach * reach + halfHeight * halfHeight);
+				if (frustum.sphereVisible(x, c.minY + halfHeight, z, radius)) {
+					visible.push_back(cell);
+				}
+			}
+		}
+	}
+}
+
+// modern path: orbits are analytic, so the vertex buffer holds each star's phase at
+// time 0 plus its phase step per tick and never changes after the upload, the shader
+// works out the position from StarField::time. ring stars just share their ring's step.
+static const double STAR_TICKS_PER_SECOND = 64.0;
+
+static GLuint starProgram = 0;
+static GLint starMvpLocation = -1;
+static GLint starTickLocation = -1;
+static GLint starTickFractionLocation = -1;
+static GLint starBrightnessScaleLocation = -1;
+static GLuint starVao = 0;
+static GLuint starVbo = 0;
+static unsigned int starBufferGeneration = 0;
+
+struct StarVertex {
+	float radius;
+	OrbitalPhase phase;		// at time 0
+	OrbitalPhase phaseStep;	// per tick
+	float y;
+	uint8_t r, g, b, a;		// brightness premultiplied
+};
+
+static const char* STAR_VERTEX_SHADER = R"(#version 330 core
+in float aRadius;
+in uint aPhase;
+in uint aPhaseStep;
+in float aY;
+in vec3 aColor;
+
+uniform mat4 uMVP;
+uniform uint uTick;
+uniform float uTickFraction;
+uniform float uBrightnessScale;
+
+out vec3 vColor;
+
+const float PHASE_TO_RADIANS = 6.283185307179586 / 4294967296.0;
+
+void main() {
+	// uint maths wraps around the circle exactly like OrbitalPhase on the CPU
+	uint phase = aPhase + aPhaseStep * uTick + uint(int(float(int(aPhaseStep)) * uTickFraction));
+	float angle = float(int(phase)) * PHASE_TO_RADIANS;
+
+	vColor = aColor * uBrightnessScale;
+	gl_Position = uMVP * vec4(aRadius * cos(angle), aY, aRadius * sin(angle), 1.0);
+}
+)";
+
+static const char* STAR_FRAGMENT_SHADER = R"(#version 330 core
+in vec3 vColor;
+
+out vec4 fragColor;
+
+void main() {
+	fragColor = vec4(vColor, 1.0);
+}
+)";
+
+static bool initStarProgram() {
+	starProgram = createShaderProgram("star", STAR_VERTEX_SHADER, STAR_FRAGMENT_SHADER,
+		{ "aRadius", "aPhase", "aPhaseStep", "aY", "aColor" });
+	if (!starProgram) return false;
+
+	starMvpLocation = glGetUniformLocation(starProgram, "uMVP");
+	starTickLocation = glGetUniformLocation(starProgram, "uTick");
+	starTickFractionLocation = glGetUniformLocation(starProgram, "uTickFraction");
+	starBrightnessScaleLocation = glGetUniformLocation(starProgram, "uBrightnessScale");
+
+	glGenVertexArrays(1, &starVao);
+	glGenBuffers(1, &starVbo);
+
+	glBindVertexArray(starVao);
+	glBindBuffer(GL_ARRAY_BUFFER, starVbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (const void*)offsetof(StarVertex, radius));
+	glEnableVertexAttribArray(1);
+	glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(StarVertex), (const void*)offsetof(StarVertex, phase));
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(StarVertex), (const void*)offsetof(StarVertex, phaseStep));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (const void*)offsetof(StarVertex, y));
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StarVertex), (const void*)offsetof(StarVertex, r));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+static void uploadStarBuffer(const StarField& stars) {
+	const size_t count = stars.size();
+	std::vector<StarVertex> vertices(count);
+
+	for (size_t i = 0; i < count; i++) {
+		StarVertex& v = vertices[i];
+		v.radius = stars.radius[i];
+		v.phase = stars.phase[i];
+		v.phaseStep = phaseStep(stars.angularVelocity(i), 1.0 / STAR_TICKS_PER_SECOND);
+		v.y = stars.y[i];
+		float red, green, blue;
+		starColor(stars, i, red, green, blue);
+		v.r = (uint8_t)(red * 255.0f + 0.5f);
+		v.g = (uint8_t)(green * 255.0f + 0.5f);
+		v.b = (uint8_t)(blue * 255.0f + 0.5f);
+		v.a = 255;
+	}
+
+	for (const StarRing& ring : stars.rings) {
+		OrbitalPhase step = phaseStep(ring.angularVelocity, 1.0 / STAR_TICKS_PER_SECOND);
+		for (size_t i = ring.first; i < ring.first + ring.count; i++) {
+			vertices[i].phaseStep = step;
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, starVbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(StarVertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	starBufferGeneration = stars.generation;
+}
+
+static void renderStarsModern(const StarField& stars) {
+	if (starBufferGeneration != stars.generation) {
+		uploadStarBuffer(stars);
+	}
+
+	if (stars.size() == 0) return;
+
+	// whole ticks wrap mod 2^32 along with the phase, only the fraction is a float
+	double ticks = floor(stars.time * STAR_TICKS_PER_SECOND);
+	float tickFraction = (float)(stars.time * STAR_TICKS_PER_SECOND - ticks);
+	GLuint tick = (GLuint)(uint64_t)ticks;
+
+	// straight from the camera's double matrices rather than the float stack
+	float mvp[16];
+	for (int i = 0; i < 16; i++) mvp[i] = (float)g_cameraView.viewProjection[i];
+	StarLod lod = computeStarLod(stars);
+
+	static std::vector<GLint> firsts;
+	static std::vector<GLsizei> counts;
+	firsts.clear();
+	counts.clear();
+	auto addRange = [&](size_t first, size_t count) {
+		GLsizei drawn = (GLsizei)lodCount(count, lod.fraction);
+		if (drawn == 0) return;
+		// whole cells next to each other go out as one range
+		if (lod.fraction >= 1.0f && !firsts.empty() && firsts.back() + counts.back() == (GLint)first) {
+			counts.back() += drawn;
+			return;
+		}
+		firsts.push_back((GLint)first);
+		counts.push_back(drawn);
+	};
+
+	if (stars.cells.empty()) {
+		addRange(0, stars.size());
+	}
+	else {
+		// where every ring is right now, the same sum the shader does
+		static std::vector<OrbitalPhase> ringPhases;
+		static std::vector<uint32_t> visibleCells;
+		ringPhases.resize(stars.rings.size());
+		for (size_t ring = 0; ring < stars.rings.size(); ring++) {
+			OrbitalPhase step = phaseStep(stars.rings[ring].angularVelocity, 1.0 / STAR_TICKS_PER_SECOND);
+			ringPhases[ring] = step * tick + (OrbitalPhase)(int32_t)((float)(int32_t)step * tickFraction);
+		}
+
+		findVisibleCells(stars, ringPhases, visibleCells);
+		for (uint32_t cell : visibleCells) {
+			addRange(stars.cells[cell].first, stars.cells[cell].count);
+		}
+	}
+
+	if (firsts.empty()) return;
+
+	glUseProgram(starProgram);
+	glUniformMatrix4fv(starMvpLocation, 1, GL_FALSE, mvp);
+	glUniform1ui(starTickLocation, tick);
+	glUniform1f(starTickFractionLocation, tickFraction);
+	glUniform1f(starBrightnessScaleLocation, lod.brightnessScale);
+
+	glBindVertexArray(starVao);
+	glMultiDrawArrays(GL_POINTS, firsts.data(), counts.data(), (GLsizei)firsts.size());
+	glBindVertexArray(0);
+
+	glUseProgram(0);
+}
+
+void renderStars(const StarField& stars, const RenderZone& zone) {
 	glPointSize(2.0f);
+
+	if (g_renderBackend == RenderBackend::MODERN) {
+		if (starProgram || initStarProgram()) {
+			renderStarsModern(stars);
+			return;
+		}
+		std::cout << "Star shader unavailable, falling back to the fixed-function renderer" << std::endl;
+		g_renderBackend = RenderBackend::LEGACY;
+	}
+
+	if (!stars.rings.empty()) {
+		if (ringListsGeneration != stars.generation) {
+			buildRingLists(stars);
+		}
+
+		// a ring's list is all or nothing, so it's skipped only when none of its cells show
+		static std::vector<OrbitalPhase> ringPhases;
+		static std::vector<uint32_t> visibleCells;
+		static std::vector<char> ringVisible;
+		ringPhases.resize(stars.rings.size());
+		for (size_t ring = 0; ring < stars.rings.size(); ring++) {
+			ringPhases[ring] = stars.rings[ring].phase;
+		}
+		findVisibleCells(stars, ringPhases, visibleCells);
+		ringVisible.assign(stars.rings.size(), 0);
+		for (uint32_t cell : visibleCells) {
+			ringVisible[cell / STAR_CELLS_PER_RING] = 1;
+		}
+
+		for (GLsizei ring = 0; ring < numRingLists; ring++) {
+			if (!ringVisible[ring]) continue;
+
+			// rotating about +Y by -phase moves x towards z, same direction as the orbit
+			float degrees = static_cast<float>(phaseToRadians(stars.rings[ring].phase) * 180.0 / M_PI);
+
+			glPushMatrix();
+			glRotatef(-degrees, 0.0f, 1.0f, 0.0f);
+			glCallList(ringListBase + ring);
+			glPopMatrix();
+		}
+		return;
+	}
+
+	StarLod lod = computeStarLod(stars);
+
 	glBegin(GL_POINTS);
 
-	for (const auto& star : stars) {
-		glColor3f(star.r * star.brightness,
-		          star.g * star.brightness,
-		          star.b * star.brightness);
-		glVertex3f(star.x, star.y, star.z);
+	for (size_t i = 0; i < lodCount(stars.size(), lod.fraction); i++) {
+		float red, green, blue, s, c;
+		starColor(stars, i, red, green, blue);
+		phaseSinCos(stars.phase[i], s, c);
+		glColor3f(red * lod.brightnessScale, green * lod.brightnessScale, blue * lod.brightnessScale);
+		glVertex3f(stars.radius[i] * c, stars.y[i], stars.radius[i] * s);
 	}
 
 	glEnd();
@@ -1,12 +1,18 @@
 #pragma once
+#include "AlignedAllocator.h"
+#include "OrbitalPhase.h"
 #include <vector>
 
 struct RenderZone;
 
+// spectral classes O, B, A, F, G, K, M, indices into the star palette
+const int NUM_STAR_TYPES = 7;
+
 struct Star {
 	float x, y, z;
-	float r, g, b;
+	uint8_t type;			// spectral class, index into the star palette
 	float brightness;
+	bool inBulge;
 
 	// For rotation animation
 	float radius;			// Distance from galactic center
@@ -14,6 +20,74 @@ struct Star {
 	float angularVelocity;  // Rotation speed (radians per second)
 };
 
+// stars that rotate rigidly together, see GalaxyConfig::numRotationRings
+struct StarRing {
+	size_t first, count;	// range in the StarField, stars are sorted by ring
+	float angularVelocity;
+	OrbitalPhase phase;		// rotation since generation
+	float minRadius, maxRadius;
+};
+
+// polar index over the rings: each ring is cut into angle sectors of its ring-local
+// phase, so the index turns with the ring and never needs rebuilding, and each sector
+// into height slabs (at the ring's height quartiles)
+const int STAR_RING_SECTORS = 32;
+const int STAR_HEIGHT_SLABS = 4;
+const int STAR_CELLS_PER_RING = STAR_RING_SECTORS * STAR_HEIGHT_SLABS;
+
+struct StarCell {
+	uint32_t first, count;	// range in the StarField, stars are sorted by cell
+	float minY, maxY;
+};
+
+const uint8_t STAR_FLAG_BULGE = 1;
+
+// structure-of-arrays star storage, 15 bytes a star
+// hot arrays are streamed by updateStarPositions every frame, cold ones are only read when drawing.
+// nothing derivable is stored: the colour is a palette index, the angular velocity follows
+// from the radius (or the ring) and x/z from radius and phase
+struct StarField {
+	// hot: orbit state
+	AlignedVector<float> radius;
+	AlignedVector<OrbitalPhase> phase;
+	AlignedVector<uint8_t> flags;
+
+	// cold: appearance and height
+	AlignedVector<float> y;
+	AlignedVector<uint8_t> type;
+	AlignedVector<uint8_t> brightness;	// 0-255 maps to 0-1
+
+	// ring mode: phase holds each star's phase on its ring and only the rings move
+	// stars are sorted brightest first (within each cell), the LOD draws prefixes
+	std::vector<StarRing> rings;
+	std::vector<StarCell> cells;	// ring mode only, STAR_CELLS_PER_RING per ring
+	unsigned int generation = 0;	// changes whenever the stars are regenerated
+
+	// simulation seconds since generation. the modern renderer computes every orbit
+	// from this on the GPU, only the fixed-function path needs updateStarPositions
+	double time = 0.0;
+
+	// rotation curve the stars were generated with
+	float rotationSpeed = 0.0f;
+	float bulgeRadius = 1.0f;
+	float diskRadius = 1.0f;	// for sizing the LOD
+
+	size_t size() const { return radius.size(); }
+	void resize(size_t count);
+	void clear() { resize(0); rings.clear(); cells.clear(); time = 0.0; }
+
+	void set(size_t i, const Star& star);
+	Star get(size_t i) const;
+
+	// the bulge turns as one, disk stars slow down with radius
+	float angularVelocity(float orbitRadius, bool inBulge) const {
+		if (inBulge) return rotationSpeed * 0.5f / (bulgeRadius + 1.0f);
+		return rotationSpeed / (sqrtf(orbitRadius / bulgeRadius) * (orbitRadius + 1.0f));
+	}
+	float angularVelocity(size_t i) const { return angularVelocity(radius[i], (flags[i] & STAR_FLAG_BULGE) != 0); }
+	float brightnessAt(size_t i) const { return brightness[i] * (1.0f / 255.0f); }
+};
+
 struct GalaxyConfig {
 	int numStars;
 	int numSpiralArms;
@@ -27,8 +101,13 @@ struct GalaxyConfig {
 	unsigned int seed;
 
 	double rotationSpeed;	// Base rotation multiplier
+
+	// > 0: disk stars are binned into this many radial rings (plus one for the bulge)
+	// that share an angular velocity, so a frame only advances the rings, not every star
+	int numRotationRings;
 };
 
-void generateStarField(std::vector<Star>& stars, const GalaxyConfig& config);
-void updateStarPositions(std::vector<Star>& stars, double deltaTime);
-void renderStars(const std::vector<Star>& stars, const RenderZone& zone);
+// numThreads = 0 uses every core, the result is identical for any thread count
+void generateStarField(StarField& stars, const GalaxyConfig& config, int numThreads = 0);
+void updateStarPositions(StarField& stars, double deltaTime);
+void renderStars(const StarField& stars, const RenderZone& zone);
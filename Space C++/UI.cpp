@@ -1,6 +1,6 @@
 #include "UI.h"
 #include "FontRenderer.h"
-#include <GLFW/glfw3.h>
+#include "Renderer.h"
 #include <iostream>
 #include <sstream>
 #include <cmath>
@@ -68,26 +68,44 @@ struct ButtonRect {
 static std::vector<ButtonRect> buttons;
 static double mouseX = 0, mouseY = 0;
 
+// rects are collected and drawn in one call at the end of renderUI,
+// text is queued behind them so it still ends up on top
+struct QueuedText {
+	std::string text;
+	float x, y, scale;
+	float r, g, b, a;
+};
+
+static VertexBatch rectBatch;
+static std::vector<QueuedText> queuedText;
+
+static void drawText(const std::string& text, float x, float y, float scale,
+	float r, float g, float b, float a = 1.0f) {
+	queuedText.push_back({ text, x, y, scale, r, g, b, a });
+}
+
+static void addQuad(float x1, float y1, float x2, float y2) {
+	rectBatch.begin(GL_QUADS);
+	rectBatch.vertex(x1, y1, 0.0f);
+	rectBatch.vertex(x2, y1, 0.0f);
+	rectBatch.vertex(x2, y2, 0.0f);
+	rectBatch.vertex(x1, y2, 0.0f);
+	rectBatch.end();
+}
+
 static void drawRect(float x, float y, float width, float height,
 	float r, float g, float b, float a = 1.0f, bool filled = true) {
-	glColor4f(r, g, b, a);
+	rectBatch.color(r, g, b, a);
 
 	if (filled) {
-		glBegin(GL_QUADS);
-		glVertex2f(x, y);
-		glVertex2f(x + width, y);
-		glVertex2f(x + width, y + height);
-		glVertex2f(x, y + height);
-		glEnd();
+		addQuad(x, y, x + width, y + height);
 	}
 	else {
-		glLineWidth(2.0f);
-		glBegin(GL_LINE_LOOP);
-		glVertex2f(x, y);
-		glVertex2f(x + width, y);
-		glVertex2f(x + width, y + height);
-		glVertex2f(x, y + height);
-		glEnd();
+		// 2px outline centred on the edges, same coverage as a glLineWidth(2) loop
+		addQuad(x - 1.0f, y - 1.0f, x + width + 1.0f, y + 1.0f);
+		addQuad(x - 1.0f, y + height - 1.0f, x + width + 1.0f, y + height + 1.0f);
+		addQuad(x - 1.0f, y + 1.0f, x + 1.0f, y + height - 1.0f);
+		addQuad(x + width - 1.0f, y + 1.0f, x + width + 1.0f, y + height - 1.0f);
 	}
 }
 
@@ -106,7 +124,7 @@ static void drawButton(const std::string& label, float x, float y, float width,
 	float textWidth = FontRenderer::getTextWidth(label, 1.0f);
 	float textX = x + (width - textWidth) * 0.5f;
 	float textY = y + (height * 0.5f) - 4.0f;
-	FontRenderer::renderText(label, textX, textY, 1.0f, 0.95f, 0.95f, 1.0f);
+	drawText(label, textX, textY, 1.0f, 0.95f, 0.95f, 1.0f);
 
 	buttons.push_back({ x, y, width, height, id });
 }
@@ -172,7 +190,7 @@ void applyUIChangesToConfigs(const UIState& uiState, GalaxyConfig& galaxyConfig,
 
 static void drawNumberInput(const std::string& label, int value, float x, float y, float width,
 	ButtonID incID, ButtonID decID, ButtonID resetID, bool hoveredInc, bool hoveredDec, bool hoveredReset) {
-	FontRenderer::renderText(label, x, y, 1.1f, 0.85f, 0.85f, 0.95f);
+	drawText(label, x, y, 1.1f, 0.85f, 0.85f, 0.95f);
 
 	float inputY = y + 22.0f;
 	float btnSize = 28.0f;
@@ -184,7 +202,7 @@ static void drawNumberInput(const std::string& label, int value, float x, float
 	std::stringstream ss;
 	ss << value;
 
-	FontRenderer::renderText(ss.str(), x + 10, inputY + 7, 1.2f, 1.0f, 1.0f, 1.0f);
+	drawText(ss.str(), x + 10, inputY + 7, 1.2f, 1.0f, 1.0f, 1.0f);
 
 	drawButton("-", x + inputWidth + 5, inputY, btnSize, 30.0f, decID, hoveredDec);
 	drawButton("+", x + inputWidth + btnSize + 10, inputY, btnSize, 30.0f, incID, hoveredInc);
@@ -194,7 +212,7 @@ static void drawNumberInput(const std::string& label, int value, float x, float
 static void drawFloatInput(const std::string& label, float value, float x, float y, float width,
 	ButtonID incID, ButtonID decID, ButtonID resetID, bool hoveredInc, bool hoveredDec, bool hoveredReset) {
 
-	FontRenderer::renderText(label, x, y, 1.1f, 0.85f, 0.85f, 0.95f);
+	drawText(label, x, y, 1.1f, 0.85f, 0.85f, 0.95f);
 
 	float inputY = y + 22.0f;
 	float btnSize = 28.0f;
@@ -206,7 +224,7 @@ static void drawFloatInput(const std::string& label, float value, float x, float
 	std::stringstream ss;
 	ss << std::fixed << std::setprecision(1) << value;
 
-	FontRenderer::renderText(ss.str(), x + 10, inputY + 7, 1.2f, 1.0f, 1.0f, 1.0f);
+	drawText(ss.str(), x + 10, inputY + 7, 1.2f, 1.0f, 1.0f, 1.0f);
 
 	drawButton("-", x + inputWidth + 5, inputY, btnSize, 30.0f, decID, hoveredDec);
 	drawButton("+", x + inputWidth + btnSize + 10, inputY, btnSize, 30.0f, incID, hoveredInc);
@@ -229,7 +247,7 @@ static void drawToggle(const std::string& label, bool value, float x, float y,
 		drawRect(x + 6, y + 6, boxSize - 12, boxSize - 12, 0.3f, 0.8f, 0.5f, 1.0f);
 	}
 
-	FontRenderer::renderText(label, x + boxSize + 12, y + 3, 1.1f, 0.85f, 0.85f, 0.95f);
+	drawText(label, x + boxSize + 12, y + 3, 1.1f, 0.85f, 0.85f, 0.95f);
 
 	buttons.push_back({ x, y, boxSize, boxSize, toggleID });
 }
@@ -267,10 +285,10 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 	float currentY = panelY + padding;
 	float itemX = panelX + padding;
 
-	FontRenderer::renderText("SIMULATION PARAMETERS", itemX, currentY, 1.4f, 0.4f, 0.8f, 1.0f);
+	drawText("SIMULATION PARAMETERS", itemX, currentY, 1.4f, 0.4f, 0.8f, 1.0f);
 	currentY += 35.0f;
 
-	FontRenderer::renderText("Galaxy Seed:", itemX, currentY, 1.1f, 0.85f, 0.85f, 0.95f);
+	drawText("Galaxy Seed:", itemX, currentY, 1.1f, 0.85f, 0.85f, 0.95f);
 	currentY += 25.0f;
 
 	std::stringstream seedStr;
@@ -279,7 +297,7 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 	float seedBoxWidth = contentWidth - 85.0f;
 	drawRect(itemX, currentY, seedBoxWidth, 32.0f, 0.08f, 0.08f, 0.1f, 0.95f);
 	drawRect(itemX, currentY, seedBoxWidth, 32.0f, 0.4f, 0.45f, 0.5f, 0.8f, false);
-	FontRenderer::renderText(seedStr.str(), itemX + 10, currentY + 8, 1.2f, 1.0f, 1.0f, 1.0f);
+	drawText(seedStr.str(), itemX + 10, currentY + 8, 1.2f, 1.0f, 1.0f, 1.0f);
 
 	bool hoveredCopy = (mouseX >= itemX + seedBoxWidth + 10 && mouseX <= itemX + contentWidth &&
 		mouseY >= currentY && mouseY <= currentY + 32);
@@ -301,7 +319,7 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 		isHovered(BTN_STAR_INC), isHovered(BTN_STAR_DEC), isHovered(BTN_STAR_RESET));
 	currentY += 70.0f;
 
-	FontRenderer::renderText("Simulation:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
+	drawText("Simulation:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
 	currentY += 30.0f;
 
 	drawFloatInput("Time Speed", uiState.tempTimeSpeed, itemX + 15, currentY, contentWidth - 15,
@@ -309,7 +327,7 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 		isHovered(BTN_TIME_SPEED_INC), isHovered(BTN_TIME_SPEED_DEC), isHovered(BTN_TIME_SPEED_RESET));
 	currentY += 70.0f;
 
-	FontRenderer::renderText("Black Hole:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
+	drawText("Black Hole:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
 	currentY += 30.0f;
 
 	drawFloatInput("Mass (Million M?)", uiState.tempBlackHoleMass, itemX + 15, currentY, contentWidth - 15,
@@ -317,7 +335,7 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 		isHovered(BTN_BH_MASS_INC), isHovered(BTN_BH_MASS_DEC), isHovered(BTN_BH_MASS_RESET));
 	currentY += 70.0f;
 
-	FontRenderer::renderText("Solar System:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
+	drawText("Solar System:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
 	currentY += 30.0f;
 
 	drawFloatInput("Scale Multiplier", uiState.tempSolarSystemScale, itemX + 15, currentY, contentWidth - 15,
@@ -325,7 +343,7 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 		isHovered(BTN_SS_SCALE_INC), isHovered(BTN_SS_SCALE_DEC), isHovered(BTN_SS_SCALE_RESET));
 	currentY += 70.0f;
 
-	FontRenderer::renderText("Gas Clouds:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
+	drawText("Gas Clouds:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
 	currentY += 30.0f;
 
 	drawNumberInput("Molecular", uiState.tempMolecularClouds, itemX + 15, currentY, contentWidth - 15,
@@ -358,7 +376,7 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 		isHovered(BTN_CORONAL_INC), isHovered(BTN_CORONAL_DEC), isHovered(BTN_CORONAL_RESET));
 	currentY += 75.0f;
 
-	FontRenderer::renderText("Options:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
+	drawText("Options:", itemX, currentY, 1.2f, 0.85f, 0.85f, 0.95f);
 	currentY += 30.0f;
 
 	drawToggle("Enable Turbulence", uiState.tempEnableTurbulence, itemX + 15, currentY,
@@ -377,7 +395,13 @@ void renderUI(UIState& uiState, int screenWidth, int screenHeight) {
 	drawButton("Apply Changes", itemX, currentY, contentWidth, 40.0f, BTN_APPLY, hoveredApply);
 	currentY += 50.0f;
 
-	FontRenderer::renderText("Press TAB to close | ESC to exit", itemX, currentY, 0.95f, 0.6f, 0.6f, 0.7f);
+	drawText("Press TAB to close | ESC to exit", itemX, currentY, 0.95f, 0.6f, 0.6f, 0.7f);
+
+	rectBatch.draw();
+	for (const auto& text : queuedText) {
+		FontRenderer::renderText(text.text, text.x, text.y, text.scale, text.r, text.g, text.b, text.a);
+	}
+	queuedText.clear();
 
 	glEnable(GL_DEPTH_TEST);
 
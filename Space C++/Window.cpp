@@ -2,11 +2,19 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 
+bool g_redrawRequested = true;
+
 void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
 	WIDTH = width;
 	HEIGHT = height;
 
 	glViewport(0, 0, width, height);
+	g_redrawRequested = true;
+}
+
+// the window was uncovered or its contents lost, the last frame has to be drawn again
+void windowRefreshCallback(GLFWwindow* window) {
+	g_redrawRequested = true;
 }
 
 GLFWwindow* initWindow(const WindowConfig& config) {
@@ -25,6 +33,7 @@ GLFWwindow* initWindow(const WindowConfig& config) {
 	glfwMakeContextCurrent(window);
 
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
 	glViewport(0, 0, config.width, config.height);
 
 	return window;
@@ -14,4 +14,9 @@ struct GLFWwindow* initWindow(const WindowConfig& config);
 void setupOpenGL();
 void cleanup(struct GLFWwindow* window);
 
+// set by the window and input callbacks when the next frame has to be drawn, the main
+// loop clears it once it has (a paused, still view is otherwise not redrawn)
+extern bool g_redrawRequested;
+
 void framebufferSizeCallback(struct GLFWwindow* window, int width, int height);
+void windowRefreshCallback(struct GLFWwindow* window);
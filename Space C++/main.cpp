@@ -2,14 +2,18 @@
 #include <iostream>
 #include <random>
 #include <ctime>
+#include <algorithm>
 #include "Window.h"
 #include "Camera.h"
 #include "Stars.h"
 #include "SolarSystem.h"
 #include "BlackHole.h"
 #include "GalacticGas.h"
+#include "GalaxyImpostor.h"
+#include "GalaxyBackdrop.h"
 #include "Input.h"
 #include "UI.h"
+#include "Renderer.h"
 
 int WIDTH = 1920;
 int HEIGHT = 1080;
@@ -30,6 +34,7 @@ GalaxyConfig createDefaultGalaxyConfig() {
 	config.seed = rd();
 
 	config.rotationSpeed = 1.0;
+	config.numRotationRings = 512;
 
 	std::cout << "Galaxy seed: " << config.seed << std::endl;
 
@@ -43,7 +48,7 @@ BlackHoleConfig createDefaultBlackHoleConfig() {
 	return config;
 }
 
-void render(const std::vector<Star>& stars, const std::vector<BlackHole>& blackHoles,
+void render(const StarField& stars, const std::vector<BlackHole>& blackHoles,
 	const std::vector<GasCloud>& gasClouds, const Camera& camera, UIState& uiState) {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -51,9 +56,15 @@ void render(const std::vector<Star>& stars, const std::vector<BlackHole>& blackH
 
 	RenderZone zone = calculateRenderZone(camera);
 
-	renderStars(stars, zone);
-
-	renderGalacticGas(gasClouds, zone);
+	// far out the galaxy usually comes from the impostor cache, see GalaxyImpostor.h, and
+	// at system zoom from the backdrop around the solar system, see GalaxyBackdrop.h
+	if (!renderGalaxyBackdrop(stars, gasClouds, zone)) {
+		if (beginGalaxyImpostor(stars, gasClouds)) {
+			renderStars(stars, zone);
+			renderGalacticGas(gasClouds, zone);
+		}
+		endGalaxyImpostor();
+	}
 	renderBlackHoles(blackHoles, zone);
 
 	if (solarSystem.isGenerated) {
@@ -63,6 +74,17 @@ void render(const std::vector<Star>& stars, const std::vector<BlackHole>& blackH
 	renderUI(uiState, WIDTH, HEIGHT);
 }
 
+// anything about the camera the view depends on, changed by the input callbacks or by
+// processInput (the movement keys are polled while held)
+static bool cameraChanged(const Camera& a, const Camera& b) {
+	return a.posX != b.posX || a.posY != b.posY || a.posZ != b.posZ ||
+		a.pitch != b.pitch || a.yaw != b.yaw || a.zoom != b.zoom || a.zoomLevel != b.zoomLevel ||
+		a.freeZoomMode != b.freeZoomMode;
+}
+
+// how long a paused, still view sleeps between checks when no events come in
+const double IDLE_WAIT_SECONDS = 0.25;
+
 int main() {
 	srand(static_cast<unsigned int>(time(nullptr)));
 
@@ -73,6 +95,7 @@ int main() {
 	}
 
 	setupOpenGL();
+	initRenderer();
 
 	Camera camera;
 	camera.posY = 200.0;
@@ -86,7 +109,7 @@ int main() {
 
 	// Generate galaxy
 	GalaxyConfig galaxyConfig = createDefaultGalaxyConfig();
-	std::vector<Star> stars;
+	StarField stars;
 	generateStarField(stars, galaxyConfig);
 
 	BlackHoleConfig blackHoleConfig = createDefaultBlackHoleConfig();
@@ -116,6 +139,14 @@ int main() {
 
 	double lastTime = glfwGetTime();
 
+	// the camera the last frame was drawn with, for g_renderRefinement
+	Camera renderedCamera = camera;
+
+	// frame time stats for g_logFrameTimes
+	double statsTime = 0.0;
+	int statsFrames = 0;
+	double statsGasMilliseconds = 0.0;
+
 	// Main loop
 	while (!glfwWindowShouldClose(window)) {
 		double currentTime = glfwGetTime();
@@ -124,10 +155,16 @@ int main() {
 
 		double adjustedDeltaTime = deltaTime * g_currentTimeSpeed;
 
-		updateStarPositions(stars, adjustedDeltaTime);
-		updateBlackHoles(blackHoles, adjustedDeltaTime);
-		updateGalacticGas(gasClouds, adjustedDeltaTime);
-		updatePlanets(adjustedDeltaTime);
+		// a paused simulation has nothing to advance
+		if (adjustedDeltaTime != 0.0) {
+			stars.time += adjustedDeltaTime;
+			if (g_renderBackend == RenderBackend::LEGACY) {
+				updateStarPositions(stars, adjustedDeltaTime);
+			}
+			updateBlackHoles(blackHoles, adjustedDeltaTime);
+			updateGalacticGas(gasClouds, adjustedDeltaTime);
+			updatePlanets(adjustedDeltaTime);
+		}
 
 		handleUIInput(window, uiState);
 
@@ -147,13 +184,57 @@ int main() {
 
 			std::cout << "Galaxy regenerated with new parameters" << std::endl;
 			uiState.needsRegeneration = false;
+			g_redrawRequested = true;
 		}
 
 		processInput(window, camera, &uiState);
+		bool cameraMoved = cameraChanged(renderedCamera, camera);
+
+		// with the simulation paused, nothing moved, clicked or resized and the view fully
+		// refined the last frame is still on screen, so wait for input instead of drawing it again
+		if (!g_redrawRequested && adjustedDeltaTime == 0.0 && !cameraMoved &&
+			g_renderRefinement >= RENDER_REFINEMENT_STEPS) {
+			glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
+
+			// the time spent waiting isn't simulated once the speed goes up again
+			lastTime = glfwGetTime();
+			continue;
+		}
+		g_redrawRequested = false;
+
+		// cheap while moving, then a step more detail for every frame the camera holds still
+		// the steps past the usual quality only for a paused galaxy, where they're paid once
+		// before the idle wait instead of on every frame
+		int refinementLimit = adjustedDeltaTime == 0.0 ? RENDER_REFINEMENT_STEPS : 1;
+		g_renderRefinement = cameraMoved ? 0 : std::min(g_renderRefinement + 1, refinementLimit);
+		renderedCamera = camera;
+
 		render(stars, blackHoles, gasClouds, camera, uiState);
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		if (g_logFrameTimes) {
+			statsTime += deltaTime;
+			statsFrames++;
+			statsGasMilliseconds += std::max(gasPassMilliseconds(), 0.0);
+
+			if (statsTime >= 1.0) {
+				std::cout << "Frame " << statsTime * 1000.0 / statsFrames << " ms";
+				if (g_renderBackend == RenderBackend::MODERN) {
+					std::cout << ", gas " << statsGasMilliseconds / statsFrames << " ms at "
+						<< g_gasResolutionScale << " resolution";
+				}
+				std::cout << std::endl;
+				statsTime = 0.0;
+				statsFrames = 0;
+				statsGasMilliseconds = 0.0;
+			}
+		} else {
+			statsTime = 0.0;
+			statsFrames = 0;
+			statsGasMilliseconds = 0.0;
+		}
 	}
 
 	cleanup(window);